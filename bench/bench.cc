@@ -0,0 +1,1039 @@
+/* ==========================================================================
+ * bench.cc - Construction and lookup benchmarks for phf.h.
+ * --------------------------------------------------------------------------
+ * Build:
+ *
+ *   c++ -std=c++11 -O2 -pthread -I. -o phf-bench bench/bench.cc
+ *
+ * Every run prints one JSON object per line, suitable for jq(1) or for
+ * loading into a metrics pipeline. See usage() for the options.
+ * ==========================================================================
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility> /* std::make_index_sequence */
+#include <vector>
+
+#include <unistd.h> /* getopt(3) sysconf(3) */
+
+#if defined __linux__
+#include <linux/perf_event.h> /* struct perf_event_attr */
+#include <sys/ioctl.h>        /* ioctl(2) */
+#include <sys/syscall.h>      /* __NR_perf_event_open */
+#define BENCH_HAVE_PERF 1
+#else
+#define BENCH_HAVE_PERF 0
+#endif
+
+#if defined __x86_64__ || defined __i386__
+#include <x86intrin.h> /* __rdtscp _mm_clflush _mm_lfence _mm_mfence */
+#define BENCH_HAVE_TSC 1
+#else
+#define BENCH_HAVE_TSC 0
+#endif
+
+#include "../phf.h"
+
+
+/*
+ * K E Y  G E N E R A T O R S
+ *
+ * All generators are deterministic for a given seed so that runs can be
+ * compared. Duplicates are removed with PHF::uniq, so the actual number of
+ * keys may be slightly less than requested for the random sets.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+typedef std::mt19937_64 bench_rng_t;
+
+template<typename T>
+static std::vector<T> gen_ints(size_t n, bench_rng_t &rng) {
+	std::vector<T> k(n);
+
+	for (size_t i = 0; i < n; i++)
+		k[i] = static_cast<T>(rng());
+
+	k.resize(PHF::uniq(k.data(), k.size()));
+	std::shuffle(k.begin(), k.end(), rng);
+
+	return k;
+} /* gen_ints() */
+
+/*
+ * Zipfian integers: values are drawn from a Zipf(s=1) distribution over a
+ * universe of 64 * n values, so small values are heavily overrepresented
+ * and the unique set is dense at the low end and sparse at the high end.
+ */
+template<typename T>
+static std::vector<T> gen_zipf(size_t n, bench_rng_t &rng) {
+	std::uniform_real_distribution<double> u(0.0, 1.0);
+	double N = 64.0 * PHF_MAX(n, 1);
+	std::vector<T> k;
+
+	k.reserve(n);
+
+	while (k.size() < n) {
+		size_t want = n - k.size();
+
+		/* inverse CDF approximation for s=1: x = N^u */
+		for (size_t i = 0; i < want * 2; i++)
+			k.push_back(static_cast<T>(std::pow(N, u(rng))));
+
+		k.resize(PHF::uniq(k.data(), k.size()));
+		if (k.size() > n)
+			k.resize(n);
+	}
+
+	std::shuffle(k.begin(), k.end(), rng);
+
+	return k;
+} /* gen_zipf() */
+
+static std::vector<std::string> gen_uuids(size_t n, bench_rng_t &rng) {
+	static const char hex[] = "0123456789abcdef";
+	std::vector<std::string> k(n);
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t hi = rng(), lo = rng();
+		std::string s(36, '-');
+
+		for (size_t j = 0, b = 0; j < 36; j++) {
+			if (j == 8 || j == 13 || j == 18 || j == 23)
+				continue;
+			uint64_t &w = (b < 16)? hi : lo;
+			s[j] = hex[w & 15];
+			w >>= 4;
+			b++;
+		}
+		s[14] = '4'; /* version 4 */
+
+		k[i] = s;
+	}
+
+	k.resize(PHF::uniq(k.data(), k.size()));
+	std::shuffle(k.begin(), k.end(), rng);
+
+	return k;
+} /* gen_uuids() */
+
+static std::vector<std::string> gen_urls(size_t n, bench_rng_t &rng) {
+	static const char *const host[] = { "www.example.com", "cdn.example.net", "api.example.org", "static.example.io" };
+	static const char *const dir[] = { "/", "/img/", "/v1/users/", "/assets/js/", "/blog/2019/05/", "/search?q=" };
+	std::vector<std::string> k(n);
+	char buf[32];
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t x = rng();
+
+		snprintf(buf, sizeof buf, "%llu", (unsigned long long)(x >> 16));
+		k[i] = std::string("https://") + host[x % PHF_COUNTOF(host)] + dir[(x >> 8) % PHF_COUNTOF(dir)] + buf;
+	}
+
+	k.resize(PHF::uniq(k.data(), k.size()));
+	std::shuffle(k.begin(), k.end(), rng);
+
+	return k;
+} /* gen_urls() */
+
+
+/*
+ * B E N C H M A R K  D R I V E R
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+static uint64_t bench_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+} /* bench_now() */
+
+/*
+ * Rewrite an uncompacted displacement map to the requested integer width,
+ * the same way PHF::compact would if it picked that width. Returns false if
+ * the displacement values do not fit.
+ */
+static bool bench_narrow(struct phf *f, unsigned width) {
+	if (f->g_op == PHF_G_NONE_BAND_M)
+		return true; /* tiny set, no map to narrow */
+
+	switch (width) {
+	case 8:
+		if (f->d_max > 255)
+			return false;
+		phf_memmove(reinterpret_cast<uint8_t *>(f->g), f->g, f->r);
+		f->g_op = phf_gresize(f->g_op, sizeof (uint8_t));
+		return true;
+	case 16:
+		if (f->d_max > 65535)
+			return false;
+		phf_memmove(reinterpret_cast<uint16_t *>(f->g), f->g, f->r);
+		f->g_op = phf_gresize(f->g_op, sizeof (uint16_t));
+		return true;
+	default:
+		return true;
+	}
+} /* bench_narrow() */
+
+#define BENCH_SKEW SIZE_MAX       /* span value that selects PHF::skew_init */
+#define BENCH_PAIR (SIZE_MAX - 1) /* span value that selects PHF::pair_init */
+
+static const char *bench_layout(size_t span) {
+	return (span == BENCH_SKEW)? "skew" : (span == BENCH_PAIR)? "pair" : (span)? "part" : "flat";
+} /* bench_layout() */
+
+/* partition span for the output, 0 unless PHF::part_init */
+static size_t bench_span(size_t span) {
+	return (span == BENCH_SKEW || span == BENCH_PAIR)? 0 : span;
+} /* bench_span() */
+
+/* PHF::init, PHF::part_init with span buckets per partition, PHF::skew_init or PHF::pair_init */
+template<typename key_t, bool nodiv>
+static int bench_init(struct phf *f, const std::vector<key_t> &k, size_t l, size_t a, size_t span, phf_seed_t seed, struct phf_stats *st) {
+	if (span == BENCH_SKEW)
+		return PHF::skew_init<key_t>(f, k.data(), k.size(), l, a, seed, st);
+	if (span == BENCH_PAIR)
+		return PHF::pair_init<key_t, nodiv>(f, k.data(), k.size(), l, a, seed, st);
+	if (span)
+		return PHF::part_init<key_t>(f, k.data(), k.size(), l, a, seed, span, st);
+
+	return PHF::init<key_t, nodiv>(f, k.data(), k.size(), l, a, seed, st);
+} /* bench_init() */
+
+struct bench_opts {
+	std::vector<size_t> n, l, a;
+	std::vector<unsigned> width;
+	std::vector<size_t> threads;
+	std::vector<int> huge; /* PHF::hugepage flags, 0 for the heap */
+	std::vector<size_t> span; /* PHF::part_init buckets per partition, 0 for PHF::init, or BENCH_SKEW or BENCH_PAIR */
+	size_t lookups;
+	unsigned reps;
+	phf_seed_t seed;
+	bool latency;
+	bool perf;
+	bool skew;
+	bool pair;
+	bool encode;
+	std::vector<size_t> leaf;   /* PHF::split_init leaf sizes, none to skip it */
+	std::vector<size_t> bucket; /* PHF::split_init bucket sizes */
+}; /* struct bench_opts */
+
+static std::vector<phf_string_t> bench_views(const std::vector<std::string> &k) {
+	std::vector<phf_string_t> v(k.size());
+
+	for (size_t i = 0; i < k.size(); i++) {
+		v[i].p = const_cast<char *>(k[i].data());
+		v[i].n = k[i].size();
+	}
+
+	return v;
+} /* bench_views() */
+
+template<typename key_t>
+static uint64_t bench_lookup(const struct phf *f, const std::vector<key_t> &q, size_t count, phf_hash_t *sink) {
+	phf_hash_t acc = 0;
+	uint64_t t0 = bench_now();
+
+	for (size_t i = 0, j = 0; i < count; i++) {
+		acc += PHF::hash(f, q[j]);
+		if (++j == q.size())
+			j = 0;
+	}
+
+	*sink += acc;
+
+	return bench_now() - t0;
+} /* bench_lookup() */
+
+template<typename key_t>
+static uint64_t bench_enc_lookup(const struct phf_enc *e, const std::vector<key_t> &q, size_t count, phf_hash_t *sink) {
+	phf_hash_t acc = 0;
+	uint64_t t0 = bench_now();
+
+	for (size_t i = 0, j = 0; i < count; i++) {
+		acc += PHF::enc_hash(e, q[j]);
+		if (++j == q.size())
+			j = 0;
+	}
+
+	*sink += acc;
+
+	return bench_now() - t0;
+} /* bench_enc_lookup() */
+
+/* re-encode f with every PHF_ENC_* kind and time lookups through each */
+template<typename key_t, bool nodiv>
+static void bench_encode(const char *type, const char *dataset, const struct phf *f, const std::vector<key_t> &k, size_t l, size_t a, size_t span, const struct bench_opts &opts) {
+	static const char *const name[] = { "auto", "compact", "part", "dict", "inter" };
+	static phf_hash_t sink;
+
+	for (uint32_t kind = PHF_ENC_COMPACT; kind <= PHF_ENC_INTER; kind++) {
+		uint64_t t_enc = UINT64_MAX, t_hit = UINT64_MAX;
+		size_t size = 0;
+
+		for (unsigned rep = 0; rep < opts.reps; rep++) {
+			struct phf_enc e;
+			uint64_t t0 = bench_now();
+			int error;
+
+			if ((error = PHF::encode(&e, f, kind))) {
+				fprintf(stderr, "PHF::encode: %s\n", strerror(error));
+				exit(EXIT_FAILURE);
+			}
+			t_enc = PHF_MIN(t_enc, bench_now() - t0);
+			t_hit = PHF_MIN(t_hit, bench_enc_lookup(&e, k, opts.lookups, &sink));
+			size = e.size;
+			PHF::enc_destroy(&e);
+		}
+
+		printf("{\"bench\":\"encode\",\"type\":\"%s\",\"keys\":\"%s\",\"nodiv\":%s,\"n\":%zu,\"l\":%zu,\"a\":%zu,\"layout\":\"%s\",\"span\":%zu,\"d_max\":%zu,\"encoding\":\"%s\","
+		    "\"encode_ns_per_key\":%.2f,\"hit_ns\":%.2f,\"bits_per_key\":%.3f}\n",
+		    type, dataset, (nodiv)? "true" : "false", k.size(), l, a, bench_layout(span), bench_span(span), f->d_max, name[kind],
+		    (double)t_enc / PHF_MAX(k.size(), 1), (double)t_hit / PHF_MAX(opts.lookups, 1),
+		    (double)size * 8 / PHF_MAX(k.size(), 1));
+		fflush(stdout);
+	}
+} /* bench_encode() */
+
+/*
+ * Run the full l, a, nodiv, g width, huge page and partition sweep for one key set. hits are the
+ * keys themselves in random order; misses are keys from an independently
+ * generated set of the same kind.
+ */
+template<typename key_t, bool nodiv>
+static void bench_run(const char *type, const char *dataset, const std::vector<key_t> &k, const std::vector<key_t> &miss, const struct bench_opts &opts) {
+	static phf_hash_t sink;
+
+	for (size_t l : opts.l) {
+		for (size_t a : opts.a) {
+			for (unsigned width : opts.width) {
+				for (int huge : opts.huge) {
+					for (size_t span : opts.span) {
+						if (span && span != BENCH_PAIR && !nodiv)
+							continue; /* PHF::part_init and PHF::skew_init have no modulo variant */
+
+						uint64_t t_init = UINT64_MAX, t_compact = UINT64_MAX, t_hit = UINT64_MAX, t_miss = UINT64_MAX;
+						struct phf_stats st;
+						size_t m = 0, r = 0, d_max = 0;
+						bool ok = true;
+
+						for (unsigned rep = 0; rep < opts.reps && ok; rep++) {
+							struct phf f;
+							uint64_t t0, t1, t2;
+							int error;
+
+							t0 = bench_now();
+							if ((error = bench_init<key_t, nodiv>(&f, k, l, a, span, opts.seed, &st))) {
+								fprintf(stderr, "PHF::init: %s\n", strerror(error));
+								exit(EXIT_FAILURE);
+							}
+							t1 = bench_now();
+							if (width == 0) {
+								PHF::compact(&f);
+							} else if (!bench_narrow(&f, width)) {
+								ok = false;
+							}
+							if (huge && (error = PHF::hugepage(&f, huge))) {
+								fprintf(stderr, "PHF::hugepage: %s\n", strerror(error));
+								exit(EXIT_FAILURE);
+							}
+							t2 = bench_now();
+
+							t_init = PHF_MIN(t_init, t1 - t0);
+							t_compact = PHF_MIN(t_compact, t2 - t1);
+
+							if (ok) {
+								t_hit = PHF_MIN(t_hit, bench_lookup(&f, k, opts.lookups, &sink));
+								t_miss = PHF_MIN(t_miss, bench_lookup(&f, miss, opts.lookups, &sink));
+							}
+
+							if (ok && opts.encode && rep == opts.reps - 1 && width == 0 && !huge)
+								bench_encode<key_t, nodiv>(type, dataset, &f, k, l, a, span, opts);
+
+							m = f.m;
+							r = f.r;
+							d_max = f.d_max;
+							PHF::destroy(&f);
+						}
+
+						if (!ok)
+							continue; /* d_max too large for requested width */
+
+						printf("{\"bench\":\"build+lookup\",\"type\":\"%s\",\"keys\":\"%s\",\"nodiv\":%s,\"n\":%zu,\"l\":%zu,\"a\":%zu,\"g_bits\":%u,\"hugepage\":%s,\"layout\":\"%s\",\"span\":%zu,\"r\":%zu,\"m\":%zu,\"d_max\":%zu,"
+						    "\"build_ns_per_key\":%.2f,\"compact_ns_per_key\":%.2f,\"hit_ns\":%.2f,\"miss_ns\":%.2f,\"bits_per_key\":%.3f}\n",
+						    type, dataset, (nodiv)? "true" : "false", k.size(), l, a,
+						    (width)? width : (d_max <= 255)? 8u : (d_max <= 65535)? 16u : 32u,
+						    (huge)? "true" : "false", bench_layout(span), bench_span(span), r, m, d_max,
+						    (double)t_init / PHF_MAX(k.size(), 1), (double)t_compact / PHF_MAX(k.size(), 1),
+						    (double)t_hit / PHF_MAX(opts.lookups, 1), (double)t_miss / PHF_MAX(opts.lookups, 1),
+						    (width)? (double)r * width / PHF_MAX(k.size(), 1) : st.compact_bits_per_key);
+						fflush(stdout);
+					}
+				}
+			}
+		}
+	}
+} /* bench_run() */
+
+template<typename key_t>
+static uint64_t bench_split_lookup(const struct phf_split *s, const std::vector<key_t> &q, size_t count, phf_hash_t *sink) {
+	phf_hash_t acc = 0;
+	uint64_t t0 = bench_now();
+
+	for (size_t i = 0, j = 0; i < count; i++) {
+		acc += PHF::split_hash(s, q[j]);
+		if (++j == q.size())
+			j = 0;
+	}
+
+	*sink += acc;
+
+	return bench_now() - t0;
+} /* bench_split_lookup() */
+
+/* PHF::split_init over the leaf and bucket sizes, built with the most threads given with -t */
+template<typename key_t>
+static void bench_split(const char *type, const char *dataset, const std::vector<key_t> &k, const std::vector<key_t> &miss, const struct bench_opts &opts) {
+	static phf_hash_t sink;
+	const unsigned threads = static_cast<unsigned>(*std::max_element(opts.threads.begin(), opts.threads.end()));
+
+	for (size_t leaf : opts.leaf) {
+		for (size_t bucket : opts.bucket) {
+			uint64_t t_init = UINT64_MAX, t_hit = UINT64_MAX, t_miss = UINT64_MAX;
+			size_t size = 0;
+
+			for (unsigned rep = 0; rep < opts.reps; rep++) {
+				struct phf_split s;
+				uint64_t t0 = bench_now();
+				int error;
+
+				if ((error = PHF::split_init<key_t>(&s, k.data(), k.size(), leaf, bucket, opts.seed, threads))) {
+					fprintf(stderr, "PHF::split_init: %s\n", strerror(error));
+					exit(EXIT_FAILURE);
+				}
+				t_init = PHF_MIN(t_init, bench_now() - t0);
+				t_hit = PHF_MIN(t_hit, bench_split_lookup(&s, k, opts.lookups, &sink));
+				t_miss = PHF_MIN(t_miss, bench_split_lookup(&s, miss, opts.lookups, &sink));
+				size = s.size;
+				PHF::split_destroy(&s);
+			}
+
+			printf("{\"bench\":\"build+lookup\",\"type\":\"%s\",\"keys\":\"%s\",\"n\":%zu,\"layout\":\"recsplit\",\"leaf\":%zu,\"bucket\":%zu,\"threads\":%u,"
+			    "\"build_ns_per_key\":%.2f,\"hit_ns\":%.2f,\"miss_ns\":%.2f,\"bits_per_key\":%.3f}\n",
+			    type, dataset, k.size(), leaf, bucket, threads,
+			    (double)t_init / PHF_MAX(k.size(), 1), (double)t_hit / PHF_MAX(opts.lookups, 1), (double)t_miss / PHF_MAX(opts.lookups, 1),
+			    (double)size * 8 / PHF_MAX(k.size(), 1));
+			fflush(stdout);
+		}
+	}
+} /* bench_split() */
+
+template<typename key_t, bool nodiv>
+static void bench_latency(const char *, const char *, const std::vector<key_t> &, const struct bench_opts &);
+
+template<typename key_t>
+static void bench_both(const char *type, const char *dataset, const std::vector<key_t> &k, const std::vector<key_t> &miss, const struct bench_opts &opts) {
+	if (opts.latency) {
+		bench_latency<key_t, true>(type, dataset, k, opts);
+		bench_latency<key_t, false>(type, dataset, k, opts);
+		return;
+	}
+
+	bench_run<key_t, true>(type, dataset, k, miss, opts);
+	bench_run<key_t, false>(type, dataset, k, miss, opts);
+	bench_split<key_t>(type, dataset, k, miss, opts);
+} /* bench_both() */
+
+static void bench_strings(const char *dataset, const std::vector<std::string> &k, const std::vector<std::string> &miss, const struct bench_opts &opts) {
+	std::vector<phf_string_t> kv = bench_views(k), mv = bench_views(miss);
+
+	bench_both("std::string", dataset, k, miss, opts);
+	bench_both("phf_string_t", dataset, kv, mv, opts);
+} /* bench_strings() */
+
+
+/*
+ * T A I L  L A T E N C Y
+ *
+ * Every lookup is timed individually, so the per-sample timer overhead is
+ * measured up front and subtracted. On x86 the TSC is used and calibrated
+ * against the monotonic clock; elsewhere the monotonic clock is used
+ * directly, which limits resolution to that of the clock. A hot lookup
+ * that completes within the timer's own latency still reads as 0.
+ *
+ * "cold" lookups evict the displacement map entry and the key from the
+ * cache hierarchy before each sample (clflush on x86, otherwise a sweep of
+ * a buffer twice the size of the last level cache between batches), which
+ * approximates a table much larger than the LLC being probed at random.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+static inline uint64_t bench_ticks() {
+#if BENCH_HAVE_TSC
+	unsigned aux;
+	uint64_t t = __rdtscp(&aux);
+	_mm_lfence();
+	return t;
+#else
+	return bench_now();
+#endif
+} /* bench_ticks() */
+
+/*
+ * Keep the compiler from moving the timed lookup across the timer reads:
+ * loads can't be hoisted above the barrier, and h must be computed before
+ * the second read.
+ */
+static inline void bench_barrier() {
+#if defined __GNUC__
+	__asm__ __volatile__ ("" ::: "memory");
+#endif
+} /* bench_barrier() */
+
+static inline void bench_consume(phf_hash_t h) {
+#if defined __GNUC__
+	__asm__ __volatile__ ("" :: "r" (h) : "memory");
+#else
+	static volatile phf_hash_t sink;
+	sink = h;
+#endif
+} /* bench_consume() */
+
+/* nanoseconds per tick */
+static double bench_tickns() {
+#if BENCH_HAVE_TSC
+	static double ns;
+
+	if (!ns) {
+		uint64_t t0 = bench_now(), c0 = bench_ticks(), t1, c1;
+
+		while ((t1 = bench_now()) - t0 < 50000000)
+			;;
+		c1 = bench_ticks();
+		ns = (double)(t1 - t0) / (double)(c1 - c0);
+	}
+
+	return ns;
+#else
+	return 1.0;
+#endif
+} /* bench_tickns() */
+
+static size_t bench_llcsize() {
+	long z = -1;
+#if defined _SC_LEVEL3_CACHE_SIZE
+	z = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+	return (z > 0)? (size_t)z : 32 * 1024 * 1024;
+} /* bench_llcsize() */
+
+static const void *bench_keyaddr(const uint32_t &k) { return &k; }
+static const void *bench_keyaddr(const uint64_t &k) { return &k; }
+static const void *bench_keyaddr(const std::string &k) { return k.data(); }
+static const void *bench_keyaddr(const phf_string_t &k) { return k.p; }
+
+/* address of the displacement map entry PHF::hash will read for key k */
+template<typename key_t>
+static const void *bench_gaddr(const struct phf *f, const key_t &k) {
+	uint32_t h = phf_g(k, f->seed);
+	size_t i;
+
+	if (f->g_op == PHF_G_NONE_BAND_M)
+		return f; /* no displacement map */
+	if (phf_layout(f) == PHF_LAYOUT_PART)
+		i = phf_part_of(h, f->pbits) * (f->r >> f->pbits) + (h & ((f->r >> f->pbits) - 1));
+	else if (phf_layout(f) == PHF_LAYOUT_SKEW)
+		i = phf_skew_g(h, f->r);
+	else
+		i = (f->nodiv)? (h & (f->r - 1)) : (h % f->r);
+
+	switch (f->g_op) {
+	case PHF_G_UINT8_MOD_R:
+	case PHF_G_UINT8_BAND_R:
+	case PHF_G_UINT8_PART_R:
+	case PHF_G_UINT8_SKEW_R:
+	case PHF_G_UINT8_PAIR_MOD_R:
+	case PHF_G_UINT8_PAIR_BAND_R:
+		return &reinterpret_cast<const uint8_t *>(f->g)[i];
+	case PHF_G_UINT16_MOD_R:
+	case PHF_G_UINT16_BAND_R:
+	case PHF_G_UINT16_PART_R:
+	case PHF_G_UINT16_SKEW_R:
+	case PHF_G_UINT16_PAIR_MOD_R:
+	case PHF_G_UINT16_PAIR_BAND_R:
+		return &reinterpret_cast<const uint16_t *>(f->g)[i];
+	default:
+		return &f->g[i];
+	}
+} /* bench_gaddr() */
+
+struct bench_perf {
+	int fd[2];
+	uint64_t count[2]; /* cache misses, branch misses */
+}; /* struct bench_perf */
+
+static void bench_perfopen(struct bench_perf *p, bool enable) {
+	p->fd[0] = p->fd[1] = -1;
+	p->count[0] = p->count[1] = 0;
+#if BENCH_HAVE_PERF
+	static const uint64_t config[] = { PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+	for (size_t i = 0; enable && i < PHF_COUNTOF(config); i++) {
+		struct perf_event_attr pe;
+
+		memset(&pe, 0, sizeof pe);
+		pe.type = PERF_TYPE_HARDWARE;
+		pe.size = sizeof pe;
+		pe.config = config[i];
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+
+		/* measure the calling thread on any CPU */
+		p->fd[i] = static_cast<int>(syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0));
+	}
+#else
+	(void)enable;
+#endif
+} /* bench_perfopen() */
+
+static void bench_perfctl(struct bench_perf *p, bool start) {
+#if BENCH_HAVE_PERF
+	for (size_t i = 0; i < PHF_COUNTOF(p->fd); i++) {
+		if (p->fd[i] < 0)
+			continue;
+		if (start) {
+			ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+		} else {
+			ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+			if (sizeof p->count[i] != read(p->fd[i], &p->count[i], sizeof p->count[i]))
+				p->count[i] = 0;
+			close(p->fd[i]);
+			p->fd[i] = -1;
+		}
+	}
+#else
+	(void)p;
+	(void)start;
+#endif
+} /* bench_perfctl() */
+
+struct bench_lat {
+	std::vector<uint64_t> ticks;
+	struct bench_perf perf;
+	phf_hash_t sink;
+}; /* struct bench_lat */
+
+template<typename key_t>
+static void bench_latthread(const struct phf *f, const std::vector<key_t> *q, const std::vector<size_t> *order, size_t count, bool cold, bool perf, struct bench_lat *out) {
+	std::vector<unsigned char> evict;
+	uint64_t overhead = UINT64_MAX;
+	phf_hash_t acc = 0;
+
+	out->ticks.resize(count);
+
+	if (cold && !BENCH_HAVE_TSC)
+		evict.resize(2 * bench_llcsize());
+
+	/* timer overhead; take the minimum of many empty samples */
+	for (size_t i = 0; i < 1000; i++) {
+		uint64_t t0 = bench_ticks();
+		bench_barrier();
+		overhead = PHF_MIN(overhead, bench_ticks() - t0);
+	}
+
+	bench_perfopen(&out->perf, perf);
+	bench_perfctl(&out->perf, true);
+
+	for (size_t i = 0; i < count; i++) {
+		const key_t &k = (*q)[(*order)[i % order->size()]];
+		uint64_t t0, t1;
+		phf_hash_t h;
+
+		if (cold) {
+#if BENCH_HAVE_TSC
+			_mm_clflush(bench_gaddr(f, k));
+			_mm_clflush(bench_keyaddr(k));
+			_mm_mfence();
+#else
+			if (i % 256 == 0) {
+				for (size_t j = 0; j < evict.size(); j += 64)
+					evict[j]++;
+			}
+#endif
+		}
+
+		t0 = bench_ticks();
+		bench_barrier();
+		h = PHF::hash(f, k);
+		bench_consume(h);
+		t1 = bench_ticks();
+		acc += h;
+
+		out->ticks[i] = (t1 - t0 > overhead)? t1 - t0 - overhead : 0;
+	}
+
+	bench_perfctl(&out->perf, false);
+
+	out->sink = acc;
+} /* bench_latthread() */
+
+static double bench_pctl(std::vector<uint64_t> &v, double p) {
+	if (v.empty())
+		return 0;
+
+	size_t i = PHF_MIN(v.size() - 1, static_cast<size_t>(p * (v.size() - 1)));
+
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+
+	return v[i] * bench_tickns();
+} /* bench_pctl() */
+
+/*
+ * Hot versus cold cache, sequential versus random key order, and each
+ * requested number of concurrent reader threads sharing one table.
+ */
+template<typename key_t, bool nodiv>
+static void bench_latency(const char *type, const char *dataset, const std::vector<key_t> &k, const struct bench_opts &opts) {
+	static phf_hash_t sink;
+	std::vector<size_t> seq(k.size()), rnd;
+
+	for (size_t i = 0; i < seq.size(); i++)
+		seq[i] = i;
+	rnd = seq;
+	std::shuffle(rnd.begin(), rnd.end(), bench_rng_t(k.size()));
+
+	for (size_t l : opts.l) {
+		for (size_t a : opts.a) {
+			for (int huge : opts.huge) {
+				for (size_t span : opts.span) {
+					if (span && span != BENCH_PAIR && !nodiv)
+						continue; /* PHF::part_init and PHF::skew_init have no modulo variant */
+
+					struct phf f;
+					struct phf_stats st;
+					int error;
+
+					if (k.empty())
+						return;
+
+					if ((error = bench_init<key_t, nodiv>(&f, k, l, a, span, opts.seed, &st))) {
+						fprintf(stderr, "PHF::init: %s\n", strerror(error));
+						exit(EXIT_FAILURE);
+					}
+					PHF::compact(&f);
+					if (huge && (error = PHF::hugepage(&f, huge))) {
+						fprintf(stderr, "PHF::hugepage: %s\n", strerror(error));
+						exit(EXIT_FAILURE);
+					}
+
+					for (int cold = 0; cold < 2; cold++) {
+						for (int random = 0; random < 2; random++) {
+							for (size_t nthreads : opts.threads) {
+								std::vector<struct bench_lat> lat(PHF_MAX(nthreads, 1));
+								std::vector<std::thread> thr;
+								std::vector<uint64_t> all;
+								uint64_t cmiss = 0, bmiss = 0, sum = 0;
+								bool counted = false;
+
+								for (size_t t = 0; t < lat.size(); t++)
+									thr.push_back(std::thread(bench_latthread<key_t>, &f, &k, (random)? &rnd : &seq, opts.lookups, cold != 0, opts.perf, &lat[t]));
+								for (size_t t = 0; t < thr.size(); t++)
+									thr[t].join();
+
+								for (size_t t = 0; t < lat.size(); t++) {
+									all.insert(all.end(), lat[t].ticks.begin(), lat[t].ticks.end());
+									cmiss += lat[t].perf.count[0];
+									bmiss += lat[t].perf.count[1];
+									counted |= lat[t].perf.count[0] || lat[t].perf.count[1];
+									sink += lat[t].sink;
+								}
+
+								for (size_t i = 0; i < all.size(); i++)
+									sum += all[i];
+
+								printf("{\"bench\":\"latency\",\"type\":\"%s\",\"keys\":\"%s\",\"nodiv\":%s,\"n\":%zu,\"l\":%zu,\"a\":%zu,\"hugepage\":%s,\"layout\":\"%s\",\"span\":%zu,\"cache\":\"%s\",\"order\":\"%s\",\"threads\":%zu,"
+								    "\"table_bytes\":%.0f,\"llc_bytes\":%zu,\"mean_ns\":%.2f,\"p50_ns\":%.2f,\"p99_ns\":%.2f,\"p999_ns\":%.2f",
+								    type, dataset, (nodiv)? "true" : "false", k.size(), l, a, (huge)? "true" : "false", bench_layout(span), bench_span(span),
+								    (cold)? "cold" : "hot", (random)? "random" : "sequential", lat.size(),
+								    st.compact_bits_per_key * k.size() / CHAR_BIT, bench_llcsize(),
+								    (all.empty())? 0.0 : sum * bench_tickns() / all.size(),
+								    bench_pctl(all, 0.50), bench_pctl(all, 0.99), bench_pctl(all, 0.999));
+								if (counted)
+									printf(",\"cache_misses\":%.4f,\"branch_misses\":%.4f", (double)cmiss / all.size(), (double)bmiss / all.size());
+								printf("}\n");
+								fflush(stdout);
+							}
+						}
+					}
+
+					PHF::destroy(&f);
+				}
+			}
+		}
+	}
+} /* bench_latency() */
+
+
+/*
+ * C O M P I L E - T I M E  T A B L E S
+ *
+ * PHF::cx::make_table promises the same function PHF::init builds, except
+ * where PHF::init maps a small set with phf_tiny instead. Check that for
+ * every set of 1 to 64 keys, and for the README's keyword example.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if PHF_HAVE_CONSTEXPR_TABLE
+template<size_t N>
+struct bench_cxkeys {
+	uint32_t k[N];
+
+	constexpr bench_cxkeys() : k() {
+		for (size_t i = 0; i < N; i++)
+			k[i] = static_cast<uint32_t>((i + 1) * UINT64_C(2654435761));
+	}
+}; /* struct bench_cxkeys */
+
+template<typename key_t, bool nodiv, typename table_t, typename cxkey_t>
+static bool bench_cxcompare(const char *type, const key_t k[], const cxkey_t cxk[], size_t n, const table_t &t) {
+	struct phf f;
+	bool tiny, same = true;
+	int error;
+
+	if ((error = PHF::init<key_t, nodiv>(&f, k, n, 4, 80, 1792))) {
+		fprintf(stderr, "PHF::init: %s\n", strerror(error));
+		return false;
+	}
+
+	tiny = f.g_op == PHF_G_NONE_BAND_M;
+	for (size_t i = 0; i < n; i++)
+		same = same && PHF::hash(&f, k[i]) == t(cxk[i]);
+
+	printf("{\"bench\":\"cx\",\"type\":\"%s\",\"nodiv\":%s,\"n\":%zu,\"tiny\":%s,\"match\":%s}\n",
+	    type, (nodiv)? "true" : "false", n, (tiny)? "true" : "false", (same)? "true" : "false");
+	PHF::destroy(&f);
+
+	return same || tiny;
+} /* bench_cxcompare() */
+
+template<bool nodiv, size_t N>
+static bool bench_cxints() {
+	static constexpr bench_cxkeys<N> keys{};
+	static constexpr auto t = PHF::cx::make_table<nodiv>(keys.k);
+
+	return bench_cxcompare<uint32_t, nodiv>("uint32_t", keys.k, keys.k, N, t);
+} /* bench_cxints() */
+
+template<bool nodiv, size_t... I>
+static bool bench_cxsweep(std::index_sequence<I...>) {
+	bool ok = true;
+
+	((ok = bench_cxints<nodiv, I + 1>() && ok), ...);
+
+	return ok;
+} /* bench_cxsweep() */
+
+template<bool nodiv>
+static bool bench_cxwords() {
+	static constexpr std::string_view kw[] = { "if", "else", "while", "for" };
+	static constexpr auto t = PHF::cx::make_table<nodiv>(kw);
+	const std::string k[] = { "if", "else", "while", "for" };
+
+	return bench_cxcompare<std::string, nodiv>("std::string", k, kw, 4, t);
+} /* bench_cxwords() */
+
+static bool bench_cxcheck() {
+	bool ok = true;
+
+	ok = bench_cxsweep<true>(std::make_index_sequence<64>()) && ok;
+	ok = bench_cxsweep<false>(std::make_index_sequence<64>()) && ok;
+	ok = bench_cxwords<true>() && ok;
+	ok = bench_cxwords<false>() && ok;
+
+	return ok;
+} /* bench_cxcheck() */
+#endif
+
+
+/*
+ * C O M M A N D  L I N E
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+static std::vector<size_t> parse_list(const char *arg) {
+	std::vector<size_t> v;
+	char *end;
+
+	while (*arg) {
+		v.push_back(strtoull(arg, &end, 10));
+		if (end == arg)
+			break;
+		arg = (*end == ',')? end + 1 : end;
+	}
+
+	return v;
+} /* parse_list() */
+
+static void usage(const char *arg0, FILE *fp) {
+	fprintf(fp,
+	    "Usage: %s [-CDEHLPS] [-n N,...] [-l L,...] [-a A,...] [-g BITS,...] [-p SPAN,...] [-R LEAF,...] [-b BUCKET,...] [-t THREADS,...] [-k SETS] [-q LOOKUPS] [-r REPS] [-s SEED]\n"
+	    "  -C           check PHF::cx::make_table against PHF::init for 1 to 64 keys, then exit\n"
+	    "  -D           also measure the CHD displacement pair solver (PHF::pair_init)\n"
+	    "  -E           also re-encode each compacted map with every PHF_ENC_* kind (PHF::encode)\n"
+	    "  -H           also measure with the displacement map in huge pages (PHF::hugepage)\n"
+	    "  -L           measure per-lookup latency percentiles instead of throughput\n"
+	    "  -P           with -L, also read perf_event cache and branch miss counters\n"
+	    "  -S           also measure the skewed bucket layout (PHF::skew_init)\n"
+	    "  -n N,...     key counts (default 1000,100000,1000000)\n"
+	    "  -l L,...     average keys per displacement bucket (default 4)\n"
+	    "  -a A,...     hash table load factor percentages (default 80)\n"
+	    "  -g BITS,...  displacement map widths: 8, 16, 32 or 0 for PHF::compact (default 0)\n"
+	    "  -p SPAN,...  buckets per partition for PHF::part_init, or 0 for PHF::init (default 0)\n"
+	    "  -R LEAF,...  also measure PHF::split_init with these leaf sizes\n"
+	    "  -b BUCKET,...  with -R, average keys per bucket (default 100)\n"
+	    "  -t N,...     with -L, numbers of concurrent reader threads; with -R, the largest is the build threads (default 1)\n"
+	    "  -k SETS      key sets, any of i (integers), z (zipfian), u (UUIDs), w (URLs) (default izuw)\n"
+	    "  -q LOOKUPS   lookups per measurement (default 1000000)\n"
+	    "  -r REPS      repetitions; the best time is reported (default 3)\n"
+	    "  -s SEED      hash seed passed to PHF::init (default 1)\n",
+	    arg0);
+} /* usage() */
+
+int main(int argc, char *argv[]) {
+	struct bench_opts opts;
+	const char *sets = "izuw";
+	int optc;
+
+	opts.n = parse_list("1000,100000,1000000");
+	opts.l = parse_list("4");
+	opts.a = parse_list("80");
+	opts.width.push_back(0);
+	opts.lookups = 1000000;
+	opts.reps = 3;
+	opts.seed = 1;
+	opts.threads.push_back(1);
+	opts.huge.push_back(0);
+	opts.span.push_back(0);
+	opts.latency = false;
+	opts.perf = false;
+	opts.skew = false;
+	opts.pair = false;
+	opts.encode = false;
+	opts.bucket = parse_list("100");
+
+	while (-1 != (optc = getopt(argc, argv, "CDEHLPSn:l:a:g:p:R:b:t:k:q:r:s:h"))) {
+		switch (optc) {
+		case 'C':
+#if PHF_HAVE_CONSTEXPR_TABLE
+			return (bench_cxcheck())? 0 : EXIT_FAILURE;
+#else
+			fprintf(stderr, "%s: -C requires C++17\n", argv[0]);
+			return EXIT_FAILURE;
+#endif
+		case 'D':
+			opts.pair = true;
+			break;
+		case 'E':
+			opts.encode = true;
+			break;
+		case 'H':
+			opts.huge.assign(1, 0);
+			opts.huge.push_back(PHF_HUGEPAGE_EXPLICIT | PHF_HUGEPAGE_TRANSPARENT);
+			break;
+		case 'L':
+			opts.latency = true;
+			break;
+		case 'P':
+			opts.perf = true;
+			break;
+		case 'S':
+			opts.skew = true;
+			break;
+		case 'n':
+			opts.n = parse_list(optarg);
+			break;
+		case 'l':
+			opts.l = parse_list(optarg);
+			break;
+		case 'a':
+			opts.a = parse_list(optarg);
+			break;
+		case 'g':
+			opts.width.clear();
+			for (size_t w : parse_list(optarg)) {
+				if (w != 0 && w != 8 && w != 16 && w != 32) {
+					usage(argv[0], stderr);
+					return EXIT_FAILURE;
+				}
+				opts.width.push_back(static_cast<unsigned>(w));
+			}
+			break;
+		case 'p':
+			opts.span = parse_list(optarg);
+			break;
+		case 'R':
+			opts.leaf = parse_list(optarg);
+			break;
+		case 'b':
+			opts.bucket = parse_list(optarg);
+			break;
+		case 't':
+			opts.threads = parse_list(optarg);
+			break;
+		case 'k':
+			sets = optarg;
+			break;
+		case 'q':
+			opts.lookups = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			opts.reps = PHF_MAX(1, atoi(optarg));
+			break;
+		case 's':
+			opts.seed = static_cast<phf_seed_t>(strtoul(optarg, NULL, 0));
+			break;
+		case 'h':
+			usage(argv[0], stdout);
+			return 0;
+		default:
+			usage(argv[0], stderr);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (opts.skew)
+		opts.span.push_back(BENCH_SKEW);
+	if (opts.pair)
+		opts.span.push_back(BENCH_PAIR);
+
+	for (size_t n : opts.n) {
+		bench_rng_t rng(n);
+
+		if (strchr(sets, 'i')) {
+			std::vector<uint32_t> k32 = gen_ints<uint32_t>(n, rng), m32 = gen_ints<uint32_t>(n, rng);
+			std::vector<uint64_t> k64 = gen_ints<uint64_t>(n, rng), m64 = gen_ints<uint64_t>(n, rng);
+
+			bench_both("uint32_t", "int", k32, m32, opts);
+			bench_both("uint64_t", "int", k64, m64, opts);
+		}
+
+		if (strchr(sets, 'z')) {
+			std::vector<uint32_t> k32 = gen_zipf<uint32_t>(n, rng), m32 = gen_ints<uint32_t>(n, rng);
+			std::vector<uint64_t> k64 = gen_zipf<uint64_t>(n, rng), m64 = gen_ints<uint64_t>(n, rng);
+
+			bench_both("uint32_t", "zipf", k32, m32, opts);
+			bench_both("uint64_t", "zipf", k64, m64, opts);
+		}
+
+		if (strchr(sets, 'u'))
+			bench_strings("uuid", gen_uuids(n, rng), gen_uuids(n, rng), opts);
+
+		if (strchr(sets, 'w'))
+			bench_strings("url", gen_urls(n, rng), gen_urls(n, rng), opts);
+	}
+
+	return 0;
+} /* main() */
@@ -29,6 +29,7 @@
 #include <cstddef>
 #include <cstring>
 #include <climits>
+#include <limits>     /* std::numeric_limits */
 #include <stdint.h>   /* UINT32_MAX uint32_t uint64_t */
 #include <cstdbool>  /* bool */
 #include <inttypes.h> /* PRIu32 PRIx32 */
@@ -42,7 +43,28 @@
 //#  include <sys/stat.h>
 //#  include <sys/mman.h>
 //#endif
+#ifndef PHF_HAVE_MMAP
+#if defined __unix__ || defined __APPLE__
+#define PHF_HAVE_MMAP 1
+#else
+#define PHF_HAVE_MMAP 0
+#endif
+#endif
+
+#if PHF_HAVE_MMAP
+#include <fcntl.h>    /* open(2) fcntl(2) F_ADD_SEALS */
+#include <sys/mman.h> /* mmap(2) munmap(2) memfd_create(2) */
+#include <sys/stat.h> /* fstat(2) */
+#include <unistd.h>   /* close(2) ftruncate(2) getpid(2) */
+#endif
 #include <vector>
+#include <algorithm>  /* std::sort std::upper_bound */
+#include <cmath>      /* std::lgamma std::log std::log1p std::expm1 */
+#include <atomic>     /* std::atomic */
+#include <chrono>     /* std::chrono::steady_clock */
+#include <thread>     /* std::thread */
+#include <new>        /* std::nothrow */
+#include <mutex>      /* std::mutex std::lock_guard */
 #define PHF_BITS(T) (sizeof (T) * CHAR_BIT)
 #define PHF_HOWMANY(x, y) (((x) + ((y) - 1)) / (y))
 #define PHF_MIN(a, b) (((a) < (b))? (a) : (b))
@@ -98,10 +120,52 @@
 	(phf_has_attribute(visibility) || PHF_GNUC_PREREQ(4, 0))
 #endif
 
+#ifndef PHF_HAVE_BUILTIN_POPCOUNT
+#define PHF_HAVE_BUILTIN_POPCOUNT (__GNUC__ > 0)
+#endif
+
+#ifndef PHF_HAVE_BUILTIN_CTZ
+#define PHF_HAVE_BUILTIN_CTZ (__GNUC__ > 0)
+#endif
+
 #ifndef PHF_HAVE_COMPUTED_GOTOS
 #define PHF_HAVE_COMPUTED_GOTOS (__GNUC__ > 0)
 #endif
 
+#ifndef PHF_HAVE_CONSTEXPR14
+#define PHF_HAVE_CONSTEXPR14 (__cplusplus >= 201402L)
+#endif
+
+#ifndef PHF_HAVE_CONSTEXPR_TABLE
+#define PHF_HAVE_CONSTEXPR_TABLE (__cplusplus >= 201703L)
+#endif
+
+#ifndef PHF_HAVE_MEMFD
+#if defined __linux__ && defined MFD_CLOEXEC
+#define PHF_HAVE_MEMFD 1
+#else
+#define PHF_HAVE_MEMFD 0
+#endif
+#endif
+
+#ifndef PHF_HAVE_PMR
+#if __cplusplus >= 201703L && defined __has_include
+#if __has_include(<memory_resource>)
+#define PHF_HAVE_PMR 1
+#endif
+#endif
+#endif
+#ifndef PHF_HAVE_PMR
+#define PHF_HAVE_PMR 0
+#endif
+
+/* routines usable from PHF::cx::make_table, which need relaxed constexpr */
+#if PHF_HAVE_CONSTEXPR14
+#define PHF_CONSTEXPR constexpr
+#else
+#define PHF_CONSTEXPR inline
+#endif
+
 #ifdef __clang__
 #pragma clang diagnostic push
 #if __cplusplus < 201103L
@@ -144,9 +208,52 @@ const uint32_t PHF_G_UINT16_MOD_R = 3;
 const uint32_t PHF_G_UINT16_BAND_R = 4;
 const uint32_t PHF_G_UINT32_MOD_R = 5;
 const uint32_t PHF_G_UINT32_BAND_R = 6;
+const uint32_t PHF_G_NONE_BAND_M = 7; /* no g; small sets mapped by the seed alone */
+const uint32_t PHF_G_UINT8_PART_R = 8; /* partitioned layout, see PHF::part_init */
+const uint32_t PHF_G_UINT16_PART_R = 9;
+const uint32_t PHF_G_UINT32_PART_R = 10;
+const uint32_t PHF_G_UINT8_SKEW_R = 11; /* skewed buckets, see PHF::skew_init */
+const uint32_t PHF_G_UINT16_SKEW_R = 12;
+const uint32_t PHF_G_UINT32_SKEW_R = 13;
+const uint32_t PHF_G_UINT8_PAIR_MOD_R = 14; /* displacement pairs, see PHF::pair_init */
+const uint32_t PHF_G_UINT8_PAIR_BAND_R = 15;
+const uint32_t PHF_G_UINT16_PAIR_MOD_R = 16;
+const uint32_t PHF_G_UINT16_PAIR_BAND_R = 17;
+const uint32_t PHF_G_UINT32_PAIR_MOD_R = 18;
+const uint32_t PHF_G_UINT32_PAIR_BAND_R = 19;
+
+/*
+ * PHF::uniq: hash-based, keeps input order when single-threaded. Falls
+ * back to sorting if the hash table can't be allocated.
+ */
+const int PHF_UNIQ_UNSORTED = 1;
+
+const phf_hash_t PHF_INDEX_NONE = PHF_HASH_MAX; /* PHF::init: slot holds no key */
+
+const int PHF_HUGEPAGE_TRANSPARENT = 1; /* PHF::hugealloc: madvise(MADV_HUGEPAGE) */
+const int PHF_HUGEPAGE_EXPLICIT = 2;    /* PHF::hugealloc: try MAP_HUGETLB first */
+
+const uint32_t PHF_ENC_AUTO = 0;    /* PHF::encode: fastest that fits, see there */
+const uint32_t PHF_ENC_COMPACT = 1; /* every displacement in bits(d_max) bits */
+const uint32_t PHF_ENC_PART = 2;    /* per block of 256, in the bits its own maximum needs */
+const uint32_t PHF_ENC_DICT = 3;    /* short codes for the most frequent displacements */
+const uint32_t PHF_ENC_INTER = 4;   /* low bits interleaved with exception bitmaps */
+
+/*
+ * Memory for PHF::init's scratch arrays and displacement map. allocate
+ * returns size bytes aligned to align, or NULL, and deallocate receives
+ * the same size and alignment, as with std::pmr::memory_resource.
+ */
+struct phf_allocator {
+    phf_allocator() : allocate(NULL), deallocate(NULL), ctx(NULL) {}
+
+    void *(*allocate)(void *ctx, size_t size, size_t align);
+    void (*deallocate)(void *ctx, void *p, size_t size, size_t align);
+    void *ctx;
+}; /* struct phf_allocator */
 
 struct phf {
-    phf() : nodiv(false), seed(1792), r(0), m(0), g(NULL), d_max(0), g_op(0) {}
+    phf() : nodiv(false), seed(1792), r(0), m(0), g(NULL), d_max(0), g_op(0), pbits(0), g_huge(0), alloc(NULL) {}
     bool nodiv;
     
     phf_seed_t seed;
@@ -158,9 +265,265 @@ struct phf {
     size_t d_max; /* maximum displacement value in g */
 
     uint32_t g_op;
+    unsigned pbits; /* log2 of the number of partitions of a _PART_R g_op, or of m of a _PAIR_BAND_R one */
+
+    size_t g_huge; /* bytes mapped for g by PHF::hugepage, or 0 if g is from malloc */
+    const struct phf_allocator *alloc; /* allocator of g, or NULL for malloc */
 }; /* struct phf */
 
 
+/*
+ * Optional construction statistics filled by PHF::init. Timings are wall
+ * clock nanoseconds. The displacement histogram is binned by powers of 2:
+ * d_hist[i] counts buckets whose displacement d satisfies 2^i <= d < 2^(i+1).
+ */
+struct phf_stats {
+    phf_stats() : t_hash(0), t_sort(0), t_search(0), t_total(0), attempts(0), collisions(0), bits_per_key(0), compact_bits_per_key(0), scratch(0) { dup[0] = dup[1] = 0; }
+
+    uint64_t t_hash;   /* computing g(k) % r and bucket sizes */
+    uint64_t t_sort;   /* sorting buckets by size */
+    uint64_t t_search; /* displacement search */
+    uint64_t t_total;
+
+    uint64_t attempts;   /* displacement values tried, over all buckets */
+    uint64_t collisions; /* attempts rejected because of a slot collision */
+
+    std::vector<size_t> b_hist; /* b_hist[i] is number of buckets with i keys */
+    std::vector<size_t> d_hist; /* log2-binned displacement values */
+
+    double bits_per_key;         /* size of g as returned by PHF::init */
+    double compact_bits_per_key; /* size of g after PHF::compact */
+
+    size_t scratch; /* peak bytes of temporary memory and index, excluding g */
+
+    size_t dup[2]; /* indices of a duplicate key when PHF::init fails with EEXIST */
+}; /* struct phf_stats */
+
+
+/*
+ * Monotone minimal perfect hash function built by PHF::mono_init. Maps
+ * each of n sorted keys to its rank in [0, n).
+ */
+template<typename key_t>
+struct phf_mono {
+    phf_mono() : n(0), nb(0), bshift(0), sep(NULL), rank(NULL) {}
+
+    struct phf f; /* CHD function indexing rank */
+
+    size_t n;        /* number of keys */
+    size_t nb;       /* number of rank buckets */
+    unsigned bshift; /* log2 of keys per rank bucket */
+
+    key_t *sep;     /* first key of each rank bucket */
+    uint64_t *rank; /* bshift-bit rank within bucket, indexed by hash */
+}; /* struct phf_mono */
+
+
+/*
+ * Perfect hash function accepting keys after construction, built by
+ * PHF::dynamic_init. Later keys live in a side table until a background
+ * rebuild folds them into f.
+ */
+struct phf_overflow {
+    phf_hash_t h;    /* slot f maps the key to */
+    phf_hash_t slot; /* slot assigned to the key */
+    phf_hash_t i;    /* index of the key, or PHF_INDEX_NONE if unused */
+}; /* struct phf_overflow */
+
+template<typename key_t>
+struct phf_dynamic_job;
+
+template<typename key_t>
+struct phf_dynamic {
+    phf_dynamic() : l(0), a(0), k(NULL), n(0), nk(0), n_f(0), index(NULL), m(0), cur(0), ov(NULL), ov_n(0), ov_m(0), limit(0), epoch(0), job(NULL) {}
+
+    struct phf f; /* function over k[0..n_f) */
+    size_t l, a;  /* parameters for rebuilds */
+
+    key_t *k;     /* all keys, in insertion order */
+    size_t n, nk; /* number of keys, and capacity of k */
+    size_t n_f;   /* number of keys covered by f */
+
+    phf_hash_t *index; /* slot-to-key-index map of f.m elements */
+    size_t m;          /* every hash value is less than m */
+    size_t cur;        /* where to look for the next free slot of f */
+
+    struct phf_overflow *ov; /* side table of later keys, by h */
+    size_t ov_n, ov_m;
+
+    size_t limit;   /* side table size that starts a rebuild */
+    unsigned epoch; /* incremented whenever hash values change */
+
+    struct phf_dynamic_job<key_t> *job; /* rebuild in progress */
+}; /* struct phf_dynamic */
+
+
+/*
+ * Publication point for a function swapped while other threads look it
+ * up, managed by PHF::rcu_publish. Each reader thread registers a struct
+ * phf_rcu_reader and reports quiescent states, between which it may hold
+ * the pointer returned by PHF::rcu_load.
+ */
+struct phf_rcu_reader {
+    phf_rcu_reader() : epoch(0), next(NULL) {}
+
+    alignas(64) std::atomic<uint64_t> epoch; /* last epoch seen, or 0 if offline */
+    struct phf_rcu_reader *next; /* sizeof is a cache line, so no false sharing */
+}; /* struct phf_rcu_reader */
+
+struct phf_rcu {
+    phf_rcu() : cur(NULL), epoch(1), readers(NULL) {}
+
+    alignas(64) std::atomic<struct phf *> cur; /* published function */
+    std::atomic<uint64_t> epoch;               /* incremented by every publish */
+
+    std::mutex mtx; /* serializes writers; never taken by lookups */
+    struct phf_rcu_reader *readers;
+    std::vector<std::pair<struct phf *, uint64_t> > retired; /* with epoch they were replaced at */
+}; /* struct phf_rcu */
+
+
+
+/*
+ * Function and value array in a mapping shared between processes, built
+ * by PHF::shm_create and mapped read-only by PHF::shm_attach. f.g and v
+ * point into the mapping, so f must not be passed to PHF::destroy.
+ */
+struct phf_shm {
+    phf_shm() : v(NULL), vsize(0), fd(-1), map(NULL), size(0) {}
+
+    struct phf f;
+
+    const void *v; /* value array, or NULL */
+    size_t vsize;  /* bytes at v */
+
+    int fd;      /* descriptor of the segment, e.g. to hand to other processes */
+    void *map;   /* whole mapping, header first */
+    size_t size; /* bytes at map */
+}; /* struct phf_shm */
+
+
+/*
+ * Scratch memory kept between PHF::build calls, so that building many
+ * functions in a row doesn't allocate anything but their g.
+ */
+struct phf_builder_block {
+    void *p;
+    size_t size;
+    bool used;
+}; /* struct phf_builder_block */
+
+struct phf_builder {
+    phf_builder() { memset(block, 0, sizeof block); }
+
+    struct phf_builder_block block[4]; /* PHF::init uses three at a time */
+}; /* struct phf_builder */
+
+
+/*
+ * Many small functions built together by PHF::batch_init. Their
+ * displacement maps share a single allocation, in function order.
+ */
+struct phf_batch {
+    phf_batch() : n(0), f(NULL), g(NULL), size(0) {}
+
+    size_t n;      /* number of functions */
+    struct phf *f; /* f[i].g points into g; don't PHF::destroy them */
+    void *g;       /* all displacement maps, compacted */
+    size_t size;   /* bytes at g */
+}; /* struct phf_batch */
+
+
+/*
+ * Many functions packed into one image by PHF::pack_init, in the same
+ * layout PHF::pack_write stores and PHF::pack_open maps. Each function
+ * is described by a compact entry instead of a struct phf.
+ */
+struct phf_pack_entry {
+    uint64_t g_off; /* offset of the function's map in phf_pack::g */
+    uint32_t seed;
+    uint32_t g_op;
+    uint32_t r;
+    uint32_t m;
+}; /* struct phf_pack_entry */
+
+struct phf_pack {
+    phf_pack() : n(0), e(NULL), g(NULL), base(NULL), size(0), mem(NULL), mapped(false) {}
+
+    size_t n;                       /* number of functions */
+    const struct phf_pack_entry *e; /* e[id] describes function id */
+    const char *g;                  /* all displacement maps */
+
+    void *base;  /* whole image, header first */
+    size_t size; /* bytes at base */
+    void *mem;   /* allocation holding base, unless mapped */
+    bool mapped;
+}; /* struct phf_pack */
+
+
+/*
+ * Displacement map of a function re-encoded by PHF::encode, looked up
+ * with PHF::enc_hash. The arrays are owned by the encoding, so the source
+ * function can be destroyed.
+ */
+struct phf_enc {
+    phf_enc() : kind(0), width(0), hwidth(0), w(NULL), hdr(NULL), hi(NULL), dict(NULL), size(0) {}
+
+    uint32_t kind;   /* PHF_ENC_* */
+    struct phf f;    /* parameters of the source function; f.g is NULL */
+
+    unsigned width;  /* bits per code, per low part or per short code */
+    unsigned hwidth; /* bits per high part or long code */
+
+    uint64_t *w;     /* codes */
+    uint64_t *hdr;   /* PHF_ENC_PART: word offset << 8 | bits, per block */
+    uint64_t *hi;    /* PHF_ENC_INTER, PHF_ENC_DICT: high parts or long codes of the exceptions */
+    uint32_t *dict;  /* PHF_ENC_DICT: displacements, most frequent first */
+    size_t size;     /* bytes of all four arrays */
+}; /* struct phf_enc */
+
+
+/*
+ * Monotone sequence in Elias-Fano coding: the low l bits of each element
+ * packed, and the rest in unary, with a sample every 64 elements.
+ */
+struct phf_ef {
+    phf_ef() : l(0), lo(NULL), hi(NULL), sel(NULL) {}
+
+    unsigned l;
+    const uint64_t *lo;  /* low bits */
+    const uint64_t *hi;  /* element i sets bit (v >> l) + i */
+    const uint64_t *sel; /* position in hi of every 64th element */
+}; /* struct phf_ef */
+
+/*
+ * Minimal perfect hash function built by PHF::split_init, by recursive
+ * splitting instead of CHD. As with struct phf_pack everything is in one
+ * image, the layout PHF::split_write stores and PHF::split_open maps.
+ */
+struct phf_split {
+    phf_split() : n(0), nb(0), seed(0), leaf(0), lower(0), upper(0), smax(0), rice(NULL), fixed(NULL), nodes(NULL), w(NULL), base(NULL), size(0), mem(NULL), mapped(false) {}
+
+    size_t n;            /* number of keys */
+    size_t nb;           /* number of buckets */
+    phf_seed_t seed;
+    size_t leaf;         /* largest leaf */
+    size_t lower, upper; /* largest nodes split into leaves, into lower sized parts */
+    size_t smax;         /* largest bucket */
+
+    const uint32_t *rice;  /* Golomb-Rice parameter of a node, by size */
+    const uint32_t *fixed; /* bits of fixed parts in a subtree, by size */
+    const uint32_t *nodes; /* codes in a subtree, by size */
+    struct phf_ef keys;    /* keys before each bucket */
+    struct phf_ef bits;    /* position of each bucket's codes in w */
+    const uint64_t *w;     /* codes */
+
+    void *base;  /* whole image, header first */
+    size_t size; /* bytes at base */
+    void *mem;   /* allocation holding base, unless mapped */
+    bool mapped;
+}; /* struct phf_split */
+
 
 /*
  * C + +  I N T E R F A C E S
@@ -168,13 +531,38 @@ struct phf {
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include <string> /* std::string */
+#if PHF_HAVE_PMR
+#include <memory_resource> /* std::pmr::memory_resource */
+#endif
+#if PHF_HAVE_CONSTEXPR_TABLE
+#include <string_view> /* std::string_view */
+#endif
 
 namespace PHF {
 	template<typename key_t>
-	size_t uniq(key_t[], const size_t);
+	size_t uniq(key_t[], const size_t, const int = 0, const unsigned = 1);
+
+	template<typename key_t, bool nodiv>
+	phf_error_t init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats * = NULL, phf_hash_t ** = NULL, const struct phf_allocator * = NULL);
+
+	template<typename key_t>
+	phf_error_t part_init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats * = NULL, phf_hash_t ** = NULL, const struct phf_allocator * = NULL);
+
+	template<typename key_t>
+	phf_error_t skew_init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats * = NULL, phf_hash_t ** = NULL, const struct phf_allocator * = NULL);
+
+	template<typename key_t, bool nodiv>
+	phf_error_t pair_init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats * = NULL, phf_hash_t ** = NULL, const struct phf_allocator * = NULL);
 
 	template<typename key_t, bool nodiv>
-	phf_error_t init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t);
+	phf_error_t build(struct phf_builder *, struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats * = NULL, phf_hash_t ** = NULL, const struct phf_allocator * = NULL);
+
+	void builder_destroy(struct phf_builder *);
+
+	template<typename key_t, bool nodiv>
+	phf_error_t batch_init(struct phf_batch *, const key_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned = 1, size_t * = NULL);
+
+	void batch_destroy(struct phf_batch *);
 
 	void compact(struct phf *);
 
@@ -182,28 +570,246 @@ namespace PHF {
 	phf_hash_t hash(const struct phf *, key_t);
 
 	void destroy(struct phf *);
-}
 
-extern template size_t PHF::uniq<uint32_t>(uint32_t[], const size_t);
-extern template size_t PHF::uniq<uint64_t>(uint64_t[], const size_t);
-extern template size_t PHF::uniq<phf_string_t>(phf_string_t[], const size_t);
-extern template size_t PHF::uniq<std::string>(std::string[], const size_t);
+	template<typename key_t>
+	phf_error_t rebuild(struct phf *, const key_t[], const size_t, const key_t[], const size_t, const size_t, const size_t);
+
+	template<typename key_t, bool nodiv>
+	phf_error_t dynamic_init(struct phf_dynamic<key_t> *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t = 0);
+
+	template<typename key_t>
+	phf_error_t dynamic_insert(struct phf_dynamic<key_t> *, key_t, phf_hash_t * = NULL);
+
+	template<typename key_t>
+	phf_hash_t dynamic_hash(const struct phf_dynamic<key_t> *, key_t);
+
+	template<typename key_t>
+	phf_error_t dynamic_sync(struct phf_dynamic<key_t> *, const bool = false);
+
+	template<typename key_t>
+	void dynamic_destroy(struct phf_dynamic<key_t> *);
+
+	phf_error_t rcu_publish(struct phf_rcu *, struct phf *);
+
+	inline const struct phf *rcu_load(const struct phf_rcu *);
+
+	void rcu_register(struct phf_rcu *, struct phf_rcu_reader *);
+
+	inline void rcu_quiescent(const struct phf_rcu *, struct phf_rcu_reader *);
+
+	void rcu_offline(struct phf_rcu *, struct phf_rcu_reader *);
+
+	void rcu_online(struct phf_rcu *, struct phf_rcu_reader *);
+
+	void rcu_unregister(struct phf_rcu *, struct phf_rcu_reader *);
+
+	size_t rcu_reclaim(struct phf_rcu *, const bool = false);
+
+	void rcu_destroy(struct phf_rcu *);
+
+#if PHF_HAVE_PMR
+	inline struct phf_allocator pmr(std::pmr::memory_resource *);
+#endif
+
+	phf_error_t hugealloc(void **, const size_t, const int = PHF_HUGEPAGE_EXPLICIT | PHF_HUGEPAGE_TRANSPARENT);
 
-extern template phf_error_t PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t);
+	void hugefree(void *, const size_t);
+
+	phf_error_t hugepage(struct phf *, const int = PHF_HUGEPAGE_EXPLICIT | PHF_HUGEPAGE_TRANSPARENT);
+
+	phf_error_t shm_create(struct phf_shm *, const char *, const struct phf *, const void * = NULL, const size_t = 0);
+
+	phf_error_t shm_attach(struct phf_shm *, const char *);
+
+	phf_error_t shm_attach_fd(struct phf_shm *, const int);
+
+	void shm_detach(struct phf_shm *);
+
+	phf_error_t pack_init(struct phf_pack *, const struct phf[], const size_t);
+
+	template<typename key_t>
+	phf_hash_t pack_hash(const struct phf_pack *, const size_t, key_t);
+
+	phf_error_t pack_write(const struct phf_pack *, const char *);
+
+	phf_error_t pack_open(struct phf_pack *, const char *);
+
+	void pack_destroy(struct phf_pack *);
+
+	phf_error_t encode(struct phf_enc *, const struct phf *, const uint32_t = PHF_ENC_AUTO, const size_t = 0);
+
+	template<typename key_t>
+	phf_hash_t enc_hash(const struct phf_enc *, key_t);
+
+	void enc_destroy(struct phf_enc *);
+
+	template<typename key_t>
+	phf_error_t split_init(struct phf_split *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned = 1);
+
+	template<typename key_t>
+	phf_hash_t split_hash(const struct phf_split *, key_t);
+
+	phf_error_t split_write(const struct phf_split *, const char *);
+
+	phf_error_t split_open(struct phf_split *, const char *);
+
+	void split_destroy(struct phf_split *);
+
+	template<typename key_t, typename value_t>
+	phf_error_t permute(const struct phf *, const key_t[], const value_t[], const size_t, value_t[], const unsigned = 1);
+
+	template<typename key_t, bool nodiv>
+	phf_error_t mono_init(struct phf_mono<key_t> *, const key_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+
+	template<typename key_t>
+	phf_hash_t mono_hash(const struct phf_mono<key_t> *, key_t);
+
+	template<typename key_t>
+	void mono_destroy(struct phf_mono<key_t> *);
+
+	template<typename key_t>
+	phf_error_t generate(std::ostream &, const struct phf *, const char *, const key_t[] = NULL, const size_t = 0, const char *const[] = NULL, const char * = NULL);
+}
 
-extern template phf_error_t PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-extern template phf_error_t PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t);
+extern template size_t PHF::uniq<uint32_t>(uint32_t[], const size_t, const int, const unsigned);
+extern template size_t PHF::uniq<uint64_t>(uint64_t[], const size_t, const int, const unsigned);
+extern template size_t PHF::uniq<phf_string_t>(phf_string_t[], const size_t, const int, const unsigned);
+extern template size_t PHF::uniq<std::string>(std::string[], const size_t, const int, const unsigned);
+
+extern template phf_error_t PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::part_init<uint32_t>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::part_init<uint64_t>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::part_init<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::part_init<std::string>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::skew_init<uint32_t>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::skew_init<uint64_t>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::skew_init<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::skew_init<std::string>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::pair_init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::pair_init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::pair_init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::build<uint32_t, true>(struct phf_builder *, struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<uint64_t, true>(struct phf_builder *, struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<phf_string_t, true>(struct phf_builder *, struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<std::string, true>(struct phf_builder *, struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::build<uint32_t, false>(struct phf_builder *, struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<uint64_t, false>(struct phf_builder *, struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<phf_string_t, false>(struct phf_builder *, struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+extern template phf_error_t PHF::build<std::string, false>(struct phf_builder *, struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+extern template phf_error_t PHF::batch_init<uint32_t, true>(struct phf_batch *, const uint32_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<uint64_t, true>(struct phf_batch *, const uint64_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<phf_string_t, true>(struct phf_batch *, const phf_string_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<std::string, true>(struct phf_batch *, const std::string[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+
+extern template phf_error_t PHF::batch_init<uint32_t, false>(struct phf_batch *, const uint32_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<uint64_t, false>(struct phf_batch *, const uint64_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<phf_string_t, false>(struct phf_batch *, const phf_string_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+extern template phf_error_t PHF::batch_init<std::string, false>(struct phf_batch *, const std::string[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
 
 extern template phf_hash_t PHF::hash<uint32_t>(const struct phf *, uint32_t);
 extern template phf_hash_t PHF::hash<uint64_t>(const struct phf *, uint64_t);
 extern template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, phf_string_t);
 extern template phf_hash_t PHF::hash<std::string>(const struct phf *, std::string);
 
+extern template phf_hash_t PHF::pack_hash<uint32_t>(const struct phf_pack *, const size_t, uint32_t);
+extern template phf_hash_t PHF::pack_hash<uint64_t>(const struct phf_pack *, const size_t, uint64_t);
+extern template phf_hash_t PHF::pack_hash<phf_string_t>(const struct phf_pack *, const size_t, phf_string_t);
+extern template phf_hash_t PHF::pack_hash<std::string>(const struct phf_pack *, const size_t, std::string);
+
+extern template phf_hash_t PHF::enc_hash<uint32_t>(const struct phf_enc *, uint32_t);
+extern template phf_hash_t PHF::enc_hash<uint64_t>(const struct phf_enc *, uint64_t);
+extern template phf_hash_t PHF::enc_hash<phf_string_t>(const struct phf_enc *, phf_string_t);
+extern template phf_hash_t PHF::enc_hash<std::string>(const struct phf_enc *, std::string);
+
+extern template phf_error_t PHF::split_init<uint32_t>(struct phf_split *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+extern template phf_error_t PHF::split_init<uint64_t>(struct phf_split *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+extern template phf_error_t PHF::split_init<phf_string_t>(struct phf_split *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+extern template phf_error_t PHF::split_init<std::string>(struct phf_split *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+
+extern template phf_hash_t PHF::split_hash<uint32_t>(const struct phf_split *, uint32_t);
+extern template phf_hash_t PHF::split_hash<uint64_t>(const struct phf_split *, uint64_t);
+extern template phf_hash_t PHF::split_hash<phf_string_t>(const struct phf_split *, phf_string_t);
+extern template phf_hash_t PHF::split_hash<std::string>(const struct phf_split *, std::string);
+
+extern template phf_error_t PHF::rebuild<uint32_t>(struct phf *, const uint32_t[], const size_t, const uint32_t[], const size_t, const size_t, const size_t);
+extern template phf_error_t PHF::rebuild<uint64_t>(struct phf *, const uint64_t[], const size_t, const uint64_t[], const size_t, const size_t, const size_t);
+extern template phf_error_t PHF::rebuild<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const phf_string_t[], const size_t, const size_t, const size_t);
+extern template phf_error_t PHF::rebuild<std::string>(struct phf *, const std::string[], const size_t, const std::string[], const size_t, const size_t, const size_t);
+
+extern template phf_error_t PHF::dynamic_init<uint32_t, true>(struct phf_dynamic<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<uint64_t, true>(struct phf_dynamic<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<phf_string_t, true>(struct phf_dynamic<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<std::string, true>(struct phf_dynamic<std::string> *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+
+extern template phf_error_t PHF::dynamic_init<uint32_t, false>(struct phf_dynamic<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<uint64_t, false>(struct phf_dynamic<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<phf_string_t, false>(struct phf_dynamic<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+extern template phf_error_t PHF::dynamic_init<std::string, false>(struct phf_dynamic<std::string> *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+
+extern template phf_error_t PHF::dynamic_insert<uint32_t>(struct phf_dynamic<uint32_t> *, uint32_t, phf_hash_t *);
+extern template phf_error_t PHF::dynamic_insert<uint64_t>(struct phf_dynamic<uint64_t> *, uint64_t, phf_hash_t *);
+extern template phf_error_t PHF::dynamic_insert<phf_string_t>(struct phf_dynamic<phf_string_t> *, phf_string_t, phf_hash_t *);
+extern template phf_error_t PHF::dynamic_insert<std::string>(struct phf_dynamic<std::string> *, std::string, phf_hash_t *);
+
+extern template phf_hash_t PHF::dynamic_hash<uint32_t>(const struct phf_dynamic<uint32_t> *, uint32_t);
+extern template phf_hash_t PHF::dynamic_hash<uint64_t>(const struct phf_dynamic<uint64_t> *, uint64_t);
+extern template phf_hash_t PHF::dynamic_hash<phf_string_t>(const struct phf_dynamic<phf_string_t> *, phf_string_t);
+extern template phf_hash_t PHF::dynamic_hash<std::string>(const struct phf_dynamic<std::string> *, std::string);
+
+extern template phf_error_t PHF::dynamic_sync<uint32_t>(struct phf_dynamic<uint32_t> *, const bool);
+extern template phf_error_t PHF::dynamic_sync<uint64_t>(struct phf_dynamic<uint64_t> *, const bool);
+extern template phf_error_t PHF::dynamic_sync<phf_string_t>(struct phf_dynamic<phf_string_t> *, const bool);
+extern template phf_error_t PHF::dynamic_sync<std::string>(struct phf_dynamic<std::string> *, const bool);
+
+extern template void PHF::dynamic_destroy<uint32_t>(struct phf_dynamic<uint32_t> *);
+extern template void PHF::dynamic_destroy<uint64_t>(struct phf_dynamic<uint64_t> *);
+extern template void PHF::dynamic_destroy<phf_string_t>(struct phf_dynamic<phf_string_t> *);
+extern template void PHF::dynamic_destroy<std::string>(struct phf_dynamic<std::string> *);
+
+extern template phf_error_t PHF::mono_init<uint32_t, true>(struct phf_mono<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<uint64_t, true>(struct phf_mono<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<phf_string_t, true>(struct phf_mono<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<std::string, true>(struct phf_mono<std::string> *, const std::string[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+
+extern template phf_error_t PHF::mono_init<uint32_t, false>(struct phf_mono<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<uint64_t, false>(struct phf_mono<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<phf_string_t, false>(struct phf_mono<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+extern template phf_error_t PHF::mono_init<std::string, false>(struct phf_mono<std::string> *, const std::string[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+
+extern template phf_hash_t PHF::mono_hash<uint32_t>(const struct phf_mono<uint32_t> *, uint32_t);
+extern template phf_hash_t PHF::mono_hash<uint64_t>(const struct phf_mono<uint64_t> *, uint64_t);
+extern template phf_hash_t PHF::mono_hash<phf_string_t>(const struct phf_mono<phf_string_t> *, phf_string_t);
+extern template phf_hash_t PHF::mono_hash<std::string>(const struct phf_mono<std::string> *, std::string);
+
+extern template void PHF::mono_destroy<uint32_t>(struct phf_mono<uint32_t> *);
+extern template void PHF::mono_destroy<uint64_t>(struct phf_mono<uint64_t> *);
+extern template void PHF::mono_destroy<phf_string_t>(struct phf_mono<phf_string_t> *);
+extern template void PHF::mono_destroy<std::string>(struct phf_mono<std::string> *);
+
+extern template phf_error_t PHF::generate<uint32_t>(std::ostream &, const struct phf *, const char *, const uint32_t[], const size_t, const char *const[], const char *);
+extern template phf_error_t PHF::generate<uint64_t>(std::ostream &, const struct phf *, const char *, const uint64_t[], const size_t, const char *const[], const char *);
+extern template phf_error_t PHF::generate<phf_string_t>(std::ostream &, const struct phf *, const char *, const phf_string_t[], const size_t, const char *const[], const char *);
+extern template phf_error_t PHF::generate<std::string>(std::ostream &, const struct phf *, const char *, const std::string[], const size_t, const char *const[], const char *);
+
 
 #ifdef __clang__
 #pragma clang diagnostic pop
@@ -211,14 +817,45 @@ extern template phf_hash_t PHF::hash<std::string>(const struct phf *, std::strin
 #pragma GCC diagnostic pop
 #endif
 
+/* zeroed memory from a, or from calloc(3) if a is NULL; sets errno on failure */
+inline void *phf_zalloc(const struct phf_allocator *a, size_t count, size_t size)
+{
+    void *p;
+
+    if (!a)
+	return calloc(count, size);
+
+    if (size && SIZE_MAX / size < count) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (!(p = a->allocate(a->ctx, PHF_MAX(count * size, 1), alignof(std::max_align_t)))) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    memset(p, 0, count * size);
+
+    return p;
+} /* phf_zalloc() */
+
+inline void phf_dealloc(const struct phf_allocator *a, void *p, size_t count, size_t size)
+{
+    if (!a) {
+	free(p);
+	return;
+    }
+    if (p)
+	a->deallocate(a->ctx, p, PHF_MAX(count * size, 1), alignof(std::max_align_t));
+} /* phf_dealloc() */
+
 template<typename T>
-phf_error_t phf_calloc(T **p, size_t count)
+phf_error_t phf_calloc(T **p, size_t count, const struct phf_allocator *a = NULL)
 {
     if (!std::is_trivially_copyable<T>::value) {
 	if (SIZE_MAX / sizeof **p < count)
 	    return ENOMEM;
 	
-	if (!(*p = static_cast<T*>(malloc(count * sizeof **p))))
+	if (!(*p = static_cast<T*>((a)? phf_zalloc(a, count, sizeof **p) : malloc(count * sizeof **p))))
 	    return errno;
 	
 	for (size_t i = 0; i < count; i++)
@@ -226,24 +863,48 @@ phf_error_t phf_calloc(T **p, size_t count)
 	
 	return 0;
     }
-    if (!(*p = static_cast<T*>(calloc(count, sizeof **p))))
+    if (!(*p = static_cast<T*>(phf_zalloc(a, count, sizeof **p))))
 	return errno;
     
     return 0;
 } /* phf_calloc() */
 
 template<typename T>
-void phf_freearray(T *&p, size_t count)
+void phf_freearray(T *&p, size_t count, const struct phf_allocator *a = NULL)
 {
-    if (!std::is_trivially_destructible<T>::value) {
+    if (p && !std::is_trivially_destructible<T>::value) {
 	for (size_t i = 0; i < count; i++)
 	    p[i].~T();
     }
-    (void)count;
-    free(p);
+    phf_dealloc(a, p, count, sizeof *p);
     p = NULL;
 } /* phf_freearray() */
 
+#if PHF_HAVE_PMR
+/*
+ * A struct phf_allocator backed by a memory resource, e.g. a
+ * std::pmr::monotonic_buffer_resource recycled across many builds. mr
+ * must outlive every function built with it.
+ */
+inline struct phf_allocator PHF::pmr(std::pmr::memory_resource *mr) {
+	struct phf_allocator a;
+
+	a.allocate = [](void *ctx, size_t size, size_t align) -> void * {
+		try {
+			return static_cast<std::pmr::memory_resource *>(ctx)->allocate(size, align);
+		} catch (...) {
+			return NULL;
+		}
+	};
+	a.deallocate = [](void *ctx, void *p, size_t size, size_t align) {
+		static_cast<std::pmr::memory_resource *>(ctx)->deallocate(p, size, align);
+	};
+	a.ctx = mr;
+
+	return a;
+} /* PHF::pmr() */
+#endif
+
 
 /*
  * M O D U L A R  A R I T H M E T I C  R O U T I N E S
@@ -258,7 +919,7 @@ void phf_freearray(T *&p, size_t count)
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 /* round up to nearest power of 2 */
-inline size_t phf_powerup(size_t i) {
+PHF_CONSTEXPR size_t phf_powerup(size_t i) {
 #if defined SIZE_MAX
     i--;
     i |= i >> 1;
@@ -275,8 +936,8 @@ inline size_t phf_powerup(size_t i) {
 #endif
 } /* phf_powerup() */
 
-inline uint64_t phf_a_s_mod_n(uint64_t a, uint64_t s, uint64_t n) {
-    uint64_t v;
+PHF_CONSTEXPR uint64_t phf_a_s_mod_n(uint64_t a, uint64_t s, uint64_t n) {
+    uint64_t v = 0;
     
     assert(n <= UINT32_MAX);
     
@@ -297,8 +958,8 @@ inline uint64_t phf_a_s_mod_n(uint64_t a, uint64_t s, uint64_t n) {
  * Rabin-Miller primality test adapted from Niels Ferguson and Bruce
  * Schneier, "Practical Cryptography" (Wiley, 2003), 201-204.
  */
-inline bool phf_witness(uint64_t n, uint64_t a, uint64_t s, uint64_t t) {
-    uint64_t v, i;
+PHF_CONSTEXPR bool phf_witness(uint64_t n, uint64_t a, uint64_t s, uint64_t t) {
+    uint64_t v = 0, i = 0;
     
     assert(a > 0 && a < n);
     assert(n <= UINT32_MAX);
@@ -315,13 +976,13 @@ inline bool phf_witness(uint64_t n, uint64_t a, uint64_t s, uint64_t t) {
     return 1;
 } /* phf_witness() */
 
-inline bool phf_rabinmiller(uint64_t n) {
+PHF_CONSTEXPR bool phf_rabinmiller(uint64_t n) {
     /*
      * Witness 2 is deterministic for all n < 2047. Witnesses 2, 7, 61
      * are deterministic for all n < 4,759,123,141.
      */
-    static const int witness[] = { 2, 7, 61 };
-    uint64_t s, t, i;
+    const int witness[] = { 2, 7, 61 };
+    uint64_t s = 0, t = 0, i = 0;
     
     assert(n <= UINT32_MAX);
     
@@ -348,9 +1009,9 @@ inline bool phf_rabinmiller(uint64_t n) {
     return 1;
 } /* phf_rabinmiller() */
 
-inline bool phf_isprime(size_t n) {
-    static const char map[] = { 0, 0, 2, 3, 0, 5, 0, 7 };
-    size_t i;
+PHF_CONSTEXPR bool phf_isprime(size_t n) {
+    const char map[] = { 0, 0, 2, 3, 0, 5, 0, 7 };
+    size_t i = 0;
     
     if (n < PHF_COUNTOF(map))
 	return map[n];
@@ -363,7 +1024,7 @@ inline bool phf_isprime(size_t n) {
     return phf_rabinmiller(n);
 } /* phf_isprime() */
 
-inline size_t phf_primeup(size_t n) {
+PHF_CONSTEXPR size_t phf_primeup(size_t n) {
     /* NB: 4294967291 is largest 32-bit prime */
     if (n > 4294967291)
 	return 0;
@@ -385,15 +1046,15 @@ inline size_t phf_primeup(size_t n) {
 
 typedef unsigned long phf_bits_t;
 
-inline bool phf_isset(phf_bits_t *set, size_t i) {
+PHF_CONSTEXPR bool phf_isset(phf_bits_t *set, size_t i) {
     return set[i / PHF_BITS(*set)] & ((size_t)1 << (i % PHF_BITS(*set)));
 } /* phf_isset() */
 
-inline void phf_setbit(phf_bits_t *set, size_t i) {
+PHF_CONSTEXPR void phf_setbit(phf_bits_t *set, size_t i) {
     set[i / PHF_BITS(*set)] |= ((size_t)1 << (i % PHF_BITS(*set)));
 } /* phf_setbit() */
 
-inline void phf_clrbit(phf_bits_t *set, size_t i) {
+PHF_CONSTEXPR void phf_clrbit(phf_bits_t *set, size_t i) {
     set[i / PHF_BITS(*set)] &= ~((size_t)1 << (i % PHF_BITS(*set)));
 } /* phf_clrbit() */
 
@@ -401,6 +1062,91 @@ inline void phf_clrall(phf_bits_t *set, size_t n) {
     memset(set, '\0', PHF_HOWMANY(n, PHF_BITS(*set)) * sizeof *set);
 } /* phf_clrall() */
 
+/*
+ * Packed arrays of width-bit integers, 0 < width < 64. phf_getbits may
+ * read the word following the last element, so allocate one spare word.
+ * phf_readbits and phf_writebits take a bit position instead of an index.
+ */
+inline uint64_t phf_readbits(const uint64_t *w, size_t pos, unsigned width) {
+    unsigned s = pos % 64;
+    uint64_t v = w[pos / 64] >> s;
+
+    if (s + width > 64)
+	v |= w[pos / 64 + 1] << (64 - s);
+
+    return v & ((UINT64_C(1) << width) - 1);
+} /* phf_readbits() */
+
+inline uint64_t phf_getbits(const uint64_t *w, size_t i, unsigned width) {
+    return phf_readbits(w, i * width, width);
+} /* phf_getbits() */
+
+inline unsigned phf_popcount(uint64_t x) {
+#if PHF_HAVE_BUILTIN_POPCOUNT
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & UINT64_C(0x5555555555555555));
+    x = (x & UINT64_C(0x3333333333333333)) + ((x >> 2) & UINT64_C(0x3333333333333333));
+    x = (x + (x >> 4)) & UINT64_C(0x0f0f0f0f0f0f0f0f);
+
+    return static_cast<unsigned>((x * UINT64_C(0x0101010101010101)) >> 56);
+#endif
+} /* phf_popcount() */
+
+/* v is OR'd in, so the element must be clear */
+inline void phf_writebits(uint64_t *w, size_t pos, unsigned width, uint64_t v) {
+    unsigned s = pos % 64;
+
+    w[pos / 64] |= v << s;
+    if (s + width > 64)
+	w[pos / 64 + 1] |= v >> (64 - s);
+} /* phf_writebits() */
+
+inline void phf_setbits(uint64_t *w, size_t i, unsigned width, uint64_t v) {
+    phf_writebits(w, i * width, width, v);
+} /* phf_setbits() */
+
+/* position of the lowest set bit of x, which mustn't be 0 */
+inline unsigned phf_ctz(uint64_t x) {
+#if PHF_HAVE_BUILTIN_CTZ
+    return __builtin_ctzll(x);
+#else
+    unsigned n = 0;
+
+    while (!(x & 1)) {
+	x >>= 1;
+	n++;
+    }
+
+    return n;
+#endif
+} /* phf_ctz() */
+
+/* position of set bit k, from 0, of x, which must have more than k */
+inline unsigned phf_select(uint64_t x, unsigned k) {
+    while (k--)
+	x &= x - 1;
+
+    return phf_ctz(x);
+} /* phf_select() */
+
+/* bit position just past the k-th set bit, from 1, at or after pos */
+inline size_t phf_skipbits(const uint64_t *w, size_t pos, size_t k) {
+    size_t i = pos / 64;
+    uint64_t x = w[i] & (~UINT64_C(0) << (pos % 64));
+    unsigned c;
+
+    if (!k)
+	return pos;
+
+    while ((c = phf_popcount(x)) < k) {
+	k -= c;
+	x = w[++i];
+    }
+
+    return i * 64 + phf_select(x, static_cast<unsigned>(k - 1)) + 1;
+} /* phf_skipbits() */
+
 
 /*
  * K E Y  D E D U P L I C A T I O N
@@ -423,7 +1169,7 @@ inline void phf_clrall(phf_bits_t *set, size_t n) {
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-inline uint32_t phf_round32(uint32_t k1, uint32_t h1) {
+PHF_CONSTEXPR uint32_t phf_round32(uint32_t k1, uint32_t h1) {
     k1 *= UINT32_C(0xcc9e2d51);
     k1 = PHF_ROTL(k1, 15);
     k1 *= UINT32_C(0x1b873593);
@@ -435,14 +1181,16 @@ inline uint32_t phf_round32(uint32_t k1, uint32_t h1) {
     return h1;
 } /* phf_round32() */
 
-inline uint32_t phf_round32(const unsigned char *p, size_t n, uint32_t h1) {
-    uint32_t k1;
+/* byte strings; C is char or unsigned char so that constexpr callers avoid a cast */
+template<typename C>
+PHF_CONSTEXPR uint32_t phf_round32(const C *p, size_t n, uint32_t h1) {
+    uint32_t k1 = 0;
     
     while (n >= 4) {
-	k1 = (p[0] << 24)
-	    | (p[1] << 16)
-	    | (p[2] << 8)
-	    | (p[3] << 0);
+	k1 = (static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 24)
+	    | (static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 16)
+	    | (static_cast<uint32_t>(static_cast<unsigned char>(p[2])) << 8)
+	    | (static_cast<uint32_t>(static_cast<unsigned char>(p[3])) << 0);
 	
 	h1 = phf_round32(k1, h1);
 	
@@ -454,13 +1202,13 @@ inline uint32_t phf_round32(const unsigned char *p, size_t n, uint32_t h1) {
     
     switch (n & 3) {
     case 3:
-	k1 |= p[2] << 8;
+	k1 |= static_cast<uint32_t>(static_cast<unsigned char>(p[2])) << 8;
 	PHF_FALLTHROUGH;
     case 2:
-	k1 |= p[1] << 16;
+	k1 |= static_cast<uint32_t>(static_cast<unsigned char>(p[1])) << 16;
 	PHF_FALLTHROUGH;
 	case 1:
-	    k1 |= p[0] << 24;
+	    k1 |= static_cast<uint32_t>(static_cast<unsigned char>(p[0])) << 24;
 	    h1 = phf_round32(k1, h1);
     }
     
@@ -475,7 +1223,13 @@ inline uint32_t phf_round32(std::string k, uint32_t h1) {
     return phf_round32(reinterpret_cast<const unsigned char *>(k.c_str()), k.length(), h1);
 } /* phf_round32() */
 
-inline uint32_t phf_mix32(uint32_t h1) {
+#if PHF_HAVE_CONSTEXPR_TABLE
+constexpr uint32_t phf_round32(std::string_view k, uint32_t h1) {
+    return phf_round32(k.data(), k.size(), h1);
+} /* phf_round32() */
+#endif
+
+PHF_CONSTEXPR uint32_t phf_mix32(uint32_t h1) {
     h1 ^= h1 >> 16;
     h1 *= UINT32_C(0x85ebca6b);
     h1 ^= h1 >> 13;
@@ -498,6 +1252,35 @@ inline uint32_t phf_mix32(uint32_t h1) {
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+
+/*
+ * P A R A L L E L  R O U T I N E S
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * run fn(t) for t in [0, threads), with fn(0) on the calling thread, and
+ * also any t whose thread couldn't be started
+ */
+template<typename F>
+void phf_prun(const unsigned threads, F fn) {
+    std::vector<std::thread> thr;
+    unsigned t = 1;
+
+    try {
+	thr.reserve(threads);
+	for (; t < threads; t++)
+	    thr.emplace_back(fn, t);
+    } catch (...) {
+	/* std::system_error or std::bad_alloc; nothing started for t */
+    }
+    fn(0U);
+    for (; t < threads; t++)
+	fn(t);
+    for (size_t i = 0; i < thr.size(); i++)
+	thr[i].join();
+} /* phf_prun() */
+
 /*
  * K E Y  D E D U P L I C A T I O N
  *
@@ -513,9 +1296,9 @@ namespace PHF {
 
 		template<typename T>
 		static int cmp(const T *a, const T *b) {
-			if (*a > *b)
-				return -1;
 			if (*a < *b)
+				return -1;
+			if (*a > *b)
 				return 1;
 			return 0;
 		} /* cmp() */
@@ -525,13 +1308,161 @@ namespace PHF {
 			int cmp;
 			if ((cmp = memcmp(a->p, b->p, PHF_MIN(a->n, b->n))))
 				return cmp;
-			if (a->n > b->n)
-				return -1;
 			if (a->n < b->n)
+				return -1;
+			if (a->n > b->n)
 				return 1;
 			return 0;
 		} /* cmp<phf_string_t>() */
 
+		template<typename T>
+		static bool less(const T &a, const T &b) {
+			return cmp(&a, &b) < 0;
+		} /* less() */
+
+		inline uint32_t hashkey(uint32_t k) {
+			return phf_mix32(phf_round32(k, 0));
+		} /* hashkey() */
+
+		inline uint32_t hashkey(uint64_t k) {
+			return phf_mix32(phf_round32(static_cast<uint32_t>(k >> 32), phf_round32(static_cast<uint32_t>(k), 0)));
+		} /* hashkey() */
+
+		inline uint32_t hashkey(const phf_string_t &k) {
+			return phf_mix32(phf_round32(static_cast<const unsigned char *>(k.p), k.n, 0));
+		} /* hashkey() */
+
+		inline uint32_t hashkey(const std::string &k) {
+			return phf_mix32(phf_round32(reinterpret_cast<const unsigned char *>(k.data()), k.size(), 0));
+		} /* hashkey() */
+
+		/*
+		 * LSD radix sort on 8-bit digits. All digit histograms are
+		 * collected in a single pass, and passes where every key
+		 * shares the same digit are skipped, so sets confined to a
+		 * small range need fewer than sizeof (U) passes. Returns
+		 * false if the scratch array can't be allocated.
+		 */
+		template<typename U>
+		static bool radix(U k[], const size_t n) {
+			size_t count[sizeof (U)][256];
+			U *tmp, *src, *dst;
+
+			if (n < 64) {
+				std::sort(k, &k[n]);
+				return true;
+			}
+
+			if (SIZE_MAX / sizeof *k < n || !(tmp = static_cast<U *>(malloc(n * sizeof *k))))
+				return false;
+
+			memset(count, 0, sizeof count);
+			for (size_t i = 0; i < n; i++) {
+				for (size_t b = 0; b < sizeof (U); b++)
+					count[b][(k[i] >> (b * 8)) & 255]++;
+			}
+
+			src = k;
+			dst = tmp;
+
+			for (size_t b = 0; b < sizeof (U); b++) {
+				size_t off = 0;
+
+				if (count[b][(src[0] >> (b * 8)) & 255] == n)
+					continue;
+
+				for (size_t i = 0; i < 256; i++) {
+					size_t z = count[b][i];
+					count[b][i] = off;
+					off += z;
+				}
+
+				for (size_t i = 0; i < n; i++)
+					dst[count[b][(src[i] >> (b * 8)) & 255]++] = src[i];
+
+				std::swap(src, dst);
+			}
+
+			if (src != k)
+				memcpy(k, src, n * sizeof *k);
+			free(tmp);
+
+			return true;
+		} /* radix() */
+
+		/* byte d of a string key, or -1 past the end */
+		inline int charat(const phf_string_t &k, size_t d) {
+			return (d < k.n)? static_cast<const unsigned char *>(k.p)[d] : -1;
+		} /* charat() */
+
+		inline int charat(const std::string &k, size_t d) {
+			return (d < k.size())? static_cast<unsigned char>(k[d]) : -1;
+		} /* charat() */
+
+		/* compare two string keys known to share their first d bytes */
+		template<typename T>
+		static int tailcmp(const T &a, const T &b, size_t d) {
+			int ca, cb;
+
+			do {
+				ca = charat(a, d);
+				cb = charat(b, d);
+				d++;
+			} while (ca == cb && ca != -1);
+
+			return ca - cb;
+		} /* tailcmp() */
+
+		/*
+		 * Multikey quicksort (Bentley & Sedgewick, 1997). Partitions on
+		 * byte d of each key, so common prefixes--URLs, paths--are
+		 * only ever examined once instead of in every comparison.
+		 */
+		template<typename T>
+		static void mkqs(T k[], size_t n, size_t d) {
+			while (n > 1) {
+				size_t lt, gt, i;
+				int v, a, b, c;
+
+				if (n < 16) {
+					for (i = 1; i < n; i++) {
+						for (size_t j = i; j > 0 && tailcmp(k[j], k[j - 1], d) < 0; j--)
+							std::swap(k[j], k[j - 1]);
+					}
+					return;
+				}
+
+				/* median of 3 */
+				a = charat(k[0], d);
+				b = charat(k[n / 2], d);
+				c = charat(k[n - 1], d);
+				v = PHF_MAX(PHF_MIN(a, b), PHF_MIN(PHF_MAX(a, b), c));
+
+				for (lt = 0, i = 0, gt = n; i < gt;) {
+					c = charat(k[i], d);
+					if (c < v)
+						std::swap(k[lt++], k[i++]);
+					else if (c > v)
+						std::swap(k[i], k[--gt]);
+					else
+						i++;
+				}
+
+				if (v != -1)
+					mkqs(&k[lt], gt - lt, d + 1);
+
+				/* recurse into the smaller side to bound stack depth */
+				if (lt < n - gt) {
+					mkqs(k, lt, d);
+					k += gt;
+					n -= gt;
+				} else {
+					mkqs(&k[gt], n - gt, d);
+					n = lt;
+				}
+			}
+		} /* mkqs() */
+
 		template<typename T>
 		static void sort(T k[], const size_t n) {
 
@@ -541,29 +1472,202 @@ namespace PHF {
 			}
 			qsort(k, n, sizeof *k, reinterpret_cast<int(*)(const void *, const void *)>(&cmp<T>));
 		} /* sort() */
+
+		inline void sort(uint32_t k[], const size_t n) {
+			if (!radix(k, n))
+				qsort(k, n, sizeof *k, reinterpret_cast<int(*)(const void *, const void *)>(&cmp<uint32_t>));
+		} /* sort() */
+
+		inline void sort(uint64_t k[], const size_t n) {
+			if (!radix(k, n))
+				qsort(k, n, sizeof *k, reinterpret_cast<int(*)(const void *, const void *)>(&cmp<uint64_t>));
+		} /* sort() */
+
+		inline void sort(phf_string_t k[], const size_t n) {
+			mkqs(k, n, 0);
+		} /* sort() */
+
+		inline void sort(std::string k[], const size_t n) {
+			mkqs(k, n, 0);
+		} /* sort() */
+
+		/* drop adjacent duplicates */
+		template<typename T>
+		static size_t squeeze(T k[], const size_t n) {
+			size_t i, j;
+
+			for (i = 1, j = 0; i < n; i++) {
+				if (k[i] != k[j] && ++j != i)
+					k[j] = std::move(k[i]);
+			}
+
+			return (n > 0)? j + 1 : 0;
+		} /* squeeze() */
+
+		/*
+		 * Open-addressed hash set over the output prefix of k. Keeps
+		 * the first occurrence of each key in input order. Returns
+		 * SIZE_MAX if the table can't be allocated.
+		 */
+		template<typename T>
+		static size_t hashuniq(T k[], const size_t n) {
+			size_t m = phf_powerup(PHF_MAX(n * 2, 2));
+			size_t *tab, j = 0;
+
+			if (!(tab = static_cast<size_t *>(calloc(m, sizeof *tab))))
+				return SIZE_MAX;
+
+			for (size_t i = 0; i < n; i++) {
+				size_t h = hashkey(k[i]) & (m - 1);
+
+				while (tab[h] && k[tab[h] - 1] != k[i])
+					h = (h + 1) & (m - 1);
+
+				if (tab[h])
+					continue; /* duplicate */
+
+				if (i != j)
+					k[j] = std::move(k[i]);
+				tab[h] = ++j;
+			}
+
+			free(tab);
+
+			return j;
+		} /* hashuniq() */
+
+		/*
+		 * Parallel deduplication. Keys are scattered into P partitions
+		 * such that equal keys always share a partition--by splitter
+		 * for sorted output (sample sort), by hash otherwise--then each
+		 * partition is deduplicated independently and the survivors
+		 * are moved back to the front of k. Returns SIZE_MAX if the
+		 * scratch arrays can't be allocated.
+		 */
+		template<typename T>
+		static size_t puniq(T k[], const size_t n, const bool sorted, const unsigned threads) {
+			const size_t P = static_cast<size_t>(threads) * 4;
+			std::vector<T> split;
+			std::vector<size_t> count, base, uniq, off;
+			std::atomic<size_t> next(0);
+			uint32_t *id = NULL;
+			T *tmp = NULL;
+
+			try {
+				count.assign(P * threads, 0);
+				base.assign(P + 1, 0);
+				uniq.assign(P, 0);
+				off.assign(P, 0);
+
+				if (sorted) {
+					for (size_t i = 0, z = P * 32; i < z; i++)
+						split.push_back(k[(n / z) * i]);
+					std::sort(split.begin(), split.end(), less<T>);
+					for (size_t i = 1; i < P; i++)
+						split[i - 1] = split[i * 32];
+					split.resize(P - 1);
+				}
+			} catch (std::bad_alloc &) {
+				return SIZE_MAX;
+			}
+
+			if (phf_calloc(&tmp, n))
+				return SIZE_MAX;
+			if (!(id = static_cast<uint32_t *>(malloc(n * sizeof *id)))) {
+				phf_freearray(tmp, n);
+				return SIZE_MAX;
+			}
+
+			/* partition ids and per-thread histograms */
+			phf_prun(threads, [&](unsigned t) {
+				size_t *z = &count[t * P];
+
+				for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++) {
+					if (sorted)
+						id[i] = static_cast<uint32_t>(std::upper_bound(split.begin(), split.end(), k[i], less<T>) - split.begin());
+					else
+						id[i] = static_cast<uint32_t>((static_cast<uint64_t>(hashkey(k[i])) * P) >> 32);
+					z[id[i]]++;
+				}
+			});
+
+			/* offsets in partition-major, thread-minor order */
+			for (size_t p = 0, o = 0; p < P; p++) {
+				base[p] = o;
+				for (unsigned t = 0; t < threads; t++) {
+					size_t z = count[t * P + p];
+					count[t * P + p] = o;
+					o += z;
+				}
+				base[p + 1] = o;
+			}
+
+			phf_prun(threads, [&](unsigned t) {
+				size_t *z = &count[t * P];
+
+				for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+					tmp[z[id[i]]++] = std::move(k[i]);
+			});
+
+			phf_prun(threads, [&](unsigned) {
+				size_t p;
+
+				while ((p = next++) < P) {
+					T *b = &tmp[base[p]];
+					size_t z = base[p + 1] - base[p];
+
+					if (sorted || (uniq[p] = hashuniq(b, z)) == SIZE_MAX) {
+						sort(b, z);
+						uniq[p] = squeeze(b, z);
+					}
+				}
+			});
+
+			/* partitions are ordered, so concatenating them keeps k sorted */
+			for (size_t p = 1; p < P; p++)
+				off[p] = off[p - 1] + uniq[p - 1];
+
+			next = 0;
+			phf_prun(threads, [&](unsigned) {
+				size_t p;
+
+				while ((p = next++) < P)
+					std::move(&tmp[base[p]], &tmp[base[p]] + uniq[p], &k[off[p]]);
+			});
+
+			free(id);
+			phf_freearray(tmp, n);
+
+			return off[P - 1] + uniq[P - 1];
+		} /* puniq() */
 	} /* Uniq:: */
 } /* PHF:: */
 
 
 template<typename key_t>
-size_t PHF::uniq(key_t k[], const size_t n) {
+size_t PHF::uniq(key_t k[], const size_t n, const int flags, const unsigned threads) {
     using namespace PHF::Uniq;
-    size_t i, j;
-    
-    sort<key_t>(k, n);
-    
-    for (i = 1, j = 0; i < n; i++) {
-	if (k[i] != k[j])
-	    k[++j] = k[i];
+    bool sorted = !(flags & PHF_UNIQ_UNSORTED);
+    size_t u;
+
+    /* below a few thousand keys per thread the thread startup dominates */
+    if (threads > 1 && n / threads >= 4096) {
+	if ((u = puniq(k, n, sorted, threads)) != SIZE_MAX)
+	    return u;
     }
-    
-    return (n > 0)? j + 1 : 0;
+
+    if (!sorted && (u = hashuniq(k, n)) != SIZE_MAX)
+	return u;
+
+    sort(k, n);
+
+    return squeeze(k, n);
 } /* PHF::uniq() */
 
-template size_t PHF::uniq<uint32_t>(uint32_t[], const size_t);
-template size_t PHF::uniq<uint64_t>(uint64_t[], const size_t);
-template size_t PHF::uniq<phf_string_t>(phf_string_t[], const size_t);
-template size_t PHF::uniq<std::string>(std::string[], const size_t);
+template size_t PHF::uniq<uint32_t>(uint32_t[], const size_t, const int, const unsigned);
+template size_t PHF::uniq<uint64_t>(uint64_t[], const size_t, const int, const unsigned);
+template size_t PHF::uniq<phf_string_t>(phf_string_t[], const size_t, const int, const unsigned);
+template size_t PHF::uniq<std::string>(std::string[], const size_t, const int, const unsigned);
 
 
 /*
@@ -584,7 +1688,7 @@ template size_t PHF::uniq<std::string>(std::string[], const size_t);
 
 /* 32-bit, phf_string_t, and std::string keys */
 template<typename T>
-inline uint32_t phf_g(T k, uint32_t seed) {
+PHF_CONSTEXPR uint32_t phf_g(T k, uint32_t seed) {
     uint32_t h1 = seed;
     
     h1 = phf_round32(k, h1);
@@ -593,7 +1697,7 @@ inline uint32_t phf_g(T k, uint32_t seed) {
 } /* phf_g() */
 
 template<typename T>
-inline uint32_t phf_f(uint32_t d, T k, uint32_t seed) {
+PHF_CONSTEXPR uint32_t phf_f(uint32_t d, T k, uint32_t seed) {
     uint32_t h1 = seed;
     
     h1 = phf_round32(d, h1);
@@ -604,7 +1708,7 @@ inline uint32_t phf_f(uint32_t d, T k, uint32_t seed) {
 
 
 /* 64-bit keys */
-inline uint32_t phf_g(uint64_t k, uint32_t seed) {
+PHF_CONSTEXPR uint32_t phf_g(uint64_t k, uint32_t seed) {
     uint32_t h1 = seed;
     
     h1 = phf_round32(k, h1);
@@ -613,7 +1717,7 @@ inline uint32_t phf_g(uint64_t k, uint32_t seed) {
     return phf_mix32(h1);
 } /* phf_g() */
 
-inline uint32_t phf_f(uint32_t d, uint64_t k, uint32_t seed) {
+PHF_CONSTEXPR uint32_t phf_f(uint32_t d, uint64_t k, uint32_t seed) {
     uint32_t h1 = seed;
     
     h1 = phf_round32(d, h1);
@@ -626,15 +1730,73 @@ inline uint32_t phf_f(uint32_t d, uint64_t k, uint32_t seed) {
 
 /* g() and f() which parameterize modular reduction */
 template<bool nodiv, typename T>
-inline uint32_t phf_g_mod_r(T k, uint32_t seed, size_t r) {
+PHF_CONSTEXPR uint32_t phf_g_mod_r(T k, uint32_t seed, size_t r) {
     return (nodiv)? (phf_g(k, seed) & (r - 1)) : (phf_g(k, seed) % r);
 } /* phf_g_mod_r() */
 
 template<bool nodiv, typename T>
-inline uint32_t phf_f_mod_m(uint32_t d, T k, uint32_t seed, size_t m) {
+PHF_CONSTEXPR uint32_t phf_f_mod_m(uint32_t d, T k, uint32_t seed, size_t m) {
     return (nodiv)? (phf_f(d, k, seed) & (m - 1)) : (phf_f(d, k, seed) % m);
 } /* phf_f_mod_m() */
 
+/* partition of the partitioned layout, from the high bits of g(k) */
+PHF_CONSTEXPR uint32_t phf_part_of(uint32_t h, unsigned pbits) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(h) >> (32 - pbits));
+} /* phf_part_of() */
+
+/* f(k) scaled into the mp slots of k's partition, without a division */
+template<typename T>
+PHF_CONSTEXPR uint32_t phf_part_f(uint32_t d, T k, uint32_t seed, uint32_t h, unsigned pbits, size_t mp) {
+    return static_cast<uint32_t>(phf_part_of(h, pbits) * mp + ((static_cast<uint64_t>(phf_f(d, k, seed)) * mp) >> 32));
+} /* phf_part_f() */
+
+/* skewed layout: keys with g(k) below PHF_SKEW_T, 60% of them, share the first 30% of buckets */
+#define PHF_SKEW_T UINT64_C(2576980378)
+
+/* how far g(k) is past PHF_SKEW_T, or 0, from the sign of the difference */
+PHF_CONSTEXPR uint64_t phf_skew_over(uint64_t x) {
+    return x & ((x >> 63) - 1);
+} /* phf_skew_over() */
+
+/*
+ * Piecewise linear in g(k), with slope r/2 below PHF_SKEW_T and 7r/4
+ * above it, in shifts and multiplications. Keys fall on either side at
+ * random, so this is computed without a branch, which would mispredict
+ * on 40% of lookups. r must be below 2^31.
+ */
+PHF_CONSTEXPR uint32_t phf_skew_g(uint32_t h, size_t r) {
+    return static_cast<uint32_t>((h * static_cast<uint64_t>(r >> 1) + phf_skew_over(h - PHF_SKEW_T) * (r + (r >> 2))) >> 32);
+} /* phf_skew_g() */
+
+/* f(k) scaled into m slots by multiplication */
+template<typename T>
+PHF_CONSTEXPR uint32_t phf_skew_f(uint32_t d, T k, uint32_t seed, size_t m) {
+    return static_cast<uint32_t>((static_cast<uint64_t>(phf_f(d, k, seed)) * m) >> 32);
+} /* phf_skew_f() */
+
+/*
+ * displacement pairs: slot (f1 + d0 * f2 + d1) mod m, from h1 = f(0, k)
+ * and h2 = f(1, k). g holds D = d0 * m + d1, so D mod m is d1 and, with
+ * nodiv, d0 is D >> log2(m). f2 is odd with nodiv, and nonzero otherwise,
+ * so it's coprime to m and successive d0 move a key to distinct slots.
+ */
+template<bool nodiv>
+PHF_CONSTEXPR uint32_t phf_pair_f1(uint32_t h1, size_t m) {
+    return (nodiv)? static_cast<uint32_t>(h1 & (m - 1)) : static_cast<uint32_t>(h1 % m);
+} /* phf_pair_f1() */
+
+template<bool nodiv>
+PHF_CONSTEXPR uint32_t phf_pair_f2(uint32_t h2, size_t m) {
+    return (nodiv)? static_cast<uint32_t>((h2 | 1) & (m - 1)) : static_cast<uint32_t>(h2 % (m - 1) + 1);
+} /* phf_pair_f2() */
+
+template<bool nodiv>
+PHF_CONSTEXPR uint32_t phf_pair_pos(uint32_t h1, uint32_t h2, uint32_t D, size_t m, unsigned pbits) {
+    return (nodiv)
+        ? static_cast<uint32_t>((h1 + (D >> pbits) * (h2 | 1) + D) & (m - 1))
+        : static_cast<uint32_t>((h1 + static_cast<uint64_t>(D / m) * phf_pair_f2<false>(h2, m) + D) % m);
+} /* phf_pair_pos() */
+
 
 /*
  * B U C K E T  S O R T I N G  I N T E R F A C E S
@@ -651,6 +1813,11 @@ inline uint32_t phf_f_mod_m(uint32_t d, T k, uint32_t seed, size_t m) {
  * indirection). The following section merely implements a templated
  * bucket-key structure and the comparison routine passed to qsort(3).
  *
+ * Ties within a bucket are broken by the full 32-bit hash g(k), so any
+ * duplicate keys are adjacent after sorting and PHF::init can reject them
+ * with a linear scan rather than looping forever on a bucket that no
+ * displacement can resolve.
+ *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 bool operator==(const phf_string_t &a, const phf_string_t &b) {
@@ -675,6 +1842,8 @@ template<typename T>
 struct phf_key {
 	T k;
 	phf_hash_t g; /* result of g(k) % r */
+	phf_hash_t h; /* result of g(k), to find duplicate keys */
+	phf_hash_t i; /* index of k in the input array */
 	size_t *n;  /* number of keys in bucket g */
 }; /* struct phf_key */
 
@@ -688,12 +1857,10 @@ int phf_keycmp(const phf_key<T> *a, const phf_key<T> *b) {
 	return -1;
     if (a->g < b->g)
 	return 1;
-    
-    /* duplicate key? */
-    if (a->k == b->k && a != b) {
-	assert(!(a->k == b->k));
-	abort(); /* if NDEBUG defined */
-    }
+    if (a->h > b->h)
+	return -1;
+    if (a->h < b->h)
+	return 1;
     
     return 0;
 } /* phf_keycmp() */
@@ -718,6 +1885,62 @@ void phf_keysort(phf_key<T> k[], const size_t n) {
 } /* phf_keysort() */
 
 
+/*
+ * C O N S T R U C T I O N  S T A T I S T I C S
+ *
+ * Histograms and map sizes are derived from the finished displacement map
+ * and bucket sizes so that the search loop only pays for two counters.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+inline void phf_fillstats(struct phf_stats *stats, const uint32_t *g, size_t r, const size_t *B_z, size_t n, uint32_t d_max) {
+    size_t z_max = 0, width;
+    double n1 = (double)PHF_MAX(n, 1);
+
+    for (size_t i = 0; i < r; i++)
+	z_max = PHF_MAX(z_max, B_z[i]);
+
+    stats->b_hist.assign(z_max + 1, 0);
+    stats->d_hist.assign(PHF_BITS(d_max), 0);
+
+    for (size_t i = 0; i < r; i++) {
+	uint32_t d = g[i];
+	size_t bin = 0;
+
+	stats->b_hist[B_z[i]]++;
+
+	if (B_z[i] == 0)
+	    continue; /* empty buckets have no displacement */
+
+	while (d >>= 1)
+	    bin++;
+	stats->d_hist[bin]++;
+    }
+
+    /* drop unused high bins */
+    while (!stats->d_hist.empty() && stats->d_hist.back() == 0)
+	stats->d_hist.pop_back();
+
+    width = (d_max <= 255)? 1 : (d_max <= 65535)? 2 : 4;
+    stats->bits_per_key = (double)(r * sizeof *g * CHAR_BIT) / n1;
+    stats->compact_bits_per_key = (double)(r * width * CHAR_BIT) / n1;
+} /* phf_fillstats() */
+
+/* record the indices of the first two occurrences of duplicate key dup */
+template<typename T>
+void phf_dupstats(struct phf_stats *stats, const T k[], size_t n, const T &dup) {
+    size_t i, j;
+
+    for (i = 0; i < n && !(k[i] == dup); i++)
+	;;
+    for (j = i + 1; j < n && !(k[j] == dup); j++)
+	;;
+
+    stats->dup[0] = i;
+    stats->dup[1] = j;
+} /* phf_dupstats() */
+
+
 /*
  * C O R E  F U N C T I O N  G E N E R A T O R
  *
@@ -725,26 +1948,243 @@ void phf_keysort(phf_key<T> k[], const size_t n) {
  * source file is either a simple utility routine used by PHF:init, or an
  * interface to PHF:init or the generated function state.
  *
+ * The scratch arrays B_k, B_z and T come from their own allocator, so that
+ * PHF::build can recycle them while g is allocated for the caller.
+ *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-template<typename key_t, bool nodiv>
- int PHF::init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed) {
+/*
+ * Key sets of up to PHF_TINY_MAX keys are first tried without a
+ * displacement map: we look for a seed under which g(k) & (m - 1) is
+ * already collision free, so PHF::hash costs one hash and a mask. With
+ * n keys in m slots a seed works with probability about
+ * e^(-n(n-1)/2m), so the path is only taken when the largest power of
+ * 2 not above the m the regular construction would use makes that at
+ * least e^-2, a handful of attempts on average. For 64 keys that takes
+ * m = 1024, i.e. a <= 12 with nodiv or a <= 6 without. Otherwise, or
+ * if no seed works within a small budget, or two distinct keys share
+ * all 32 bits of g(k), the regular CHD construction takes over.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PHF_TINY_MAX
+#define PHF_TINY_MAX 64 /* 0 disables the tiny set path */
+#endif
+
+/* returns ERANGE if the keys need a displacement map */
+template<typename key_t>
+phf_error_t phf_tiny(struct phf *phf, const key_t k[], const size_t n, const size_t a, const bool nodiv, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index) {
+	size_t a1 = PHF_MAX(PHF_MIN(a, 100), 1);
+	size_t m_max = PHF_MAX((n * 100) / a1, 1);
+	size_t m;
+	uint32_t h[PHF_TINY_MAX > 0? PHF_TINY_MAX : 1];
+	/* m < 2 * n * 100 / a */
+	phf_bits_t used[PHF_HOWMANY(PHF_TINY_MAX * 200 + 1, PHF_BITS(phf_bits_t))];
+	uint64_t attempts = 0, collisions = 0;
+	phf_seed_t s = seed;
+	phf_hash_t *I;
+
+	if (n == 0 || n > PHF_TINY_MAX)
+		return ERANGE;
+
+	/* no more slots than the regular construction would use */
+	m_max = (nodiv)? phf_powerup(m_max) : phf_primeup(m_max);
+	if ((m = phf_powerup(m_max)) > m_max)
+		m /= 2;
+	if (m < n || n * (n - 1) / 2 > 2 * m)
+		return ERANGE; /* a seed is unlikely at the requested load */
+
+	/* equal keys, or keys no seed can separate */
+	for (size_t i = 0; i < n; i++) {
+		h[i] = phf_g(k[i], seed);
+		for (size_t j = 0; j < i; j++) {
+			if (h[i] != h[j])
+				continue;
+			if (k[i] == k[j]) {
+				if (stats)
+					phf_dupstats(stats, k, n, k[i]);
+				return EEXIST;
+			}
+			return ERANGE;
+		}
+	}
+
+	for (;;) {
+		size_t i;
+
+		attempts++;
+		memset(used, 0, PHF_HOWMANY(m, PHF_BITS(*used)) * sizeof *used);
+
+		for (i = 0; i < n; i++) {
+			uint32_t f = ((s == seed)? h[i] : phf_g(k[i], s)) & (m - 1);
+
+			if (phf_isset(used, f))
+				break;
+			phf_setbit(used, f);
+		}
+
+		if (i == n)
+			break;
+		if (++collisions == 256)
+			return ERANGE;
+		s++;
+	}
+
+	if (index) {
+		if (!(I = static_cast<phf_hash_t *>(malloc(m * sizeof *I))))
+			return errno;
+		for (size_t i = 0; i < m; i++)
+			I[i] = PHF_INDEX_NONE;
+		for (size_t i = 0; i < n; i++)
+			I[phf_g(k[i], s) & (m - 1)] = static_cast<phf_hash_t>(i);
+		*index = I;
+	}
+
+	if (stats) {
+		stats->attempts = attempts;
+		stats->collisions = collisions;
+		stats->b_hist.clear();
+		stats->d_hist.clear();
+		stats->bits_per_key = 0;
+		stats->compact_bits_per_key = 0;
+		stats->scratch = sizeof h + sizeof used + ((index)? m * sizeof *I : 0);
+	}
+
+	phf->seed = s;
+	phf->r = 0;
+	phf->m = m;
+	phf->g = NULL;
+	phf->d_max = 0;
+	phf->g_op = PHF_G_NONE_BAND_M;
+	phf->pbits = 0;
+	phf->g_huge = 0;
+
+	return 0;
+} /* phf_tiny() */
+
+#ifndef PHF_PART_LOAD
+#define PHF_PART_LOAD 95 /* PHF::part_init: load factor of the fullest partition */
+#endif
+
+/* bucket and slot layout of phf_init */
+#define PHF_LAYOUT_FLAT 0 /* PHF::init */
+#define PHF_LAYOUT_PART 1 /* PHF::part_init */
+#define PHF_LAYOUT_SKEW 2 /* PHF::skew_init */
+#define PHF_LAYOUT_PAIR 3 /* PHF::pair_init */
+
+/* a bucket's keys under displacement pairs */
+struct phf_pair {
+	uint32_t f1, f2; /* cached once per bucket */
+	uint32_t base;   /* (f1 + d0 * f2) mod m for the current d0 */
+}; /* struct phf_pair */
+
+/*
+ * Find the first D = d0 * m + d1 that puts the z keys of P into free slots
+ * of T. For each d0 the bases must be distinct; trying the next d1 then
+ * only adds 1 to each base, without hashing the keys again.
+ */
+inline bool phf_pair_search(uint32_t *D, struct phf_pair *P, const size_t z, phf_bits_t *T, const size_t m, uint64_t *attempts, uint64_t *collisions) {
+	/* f2 is coprime to m, so d0 * f2 mod m repeats after m */
+	for (uint64_t d0 = 0; d0 < m && d0 * m + (m - 1) <= UINT32_MAX; d0++) {
+		bool distinct = true;
+
+		for (size_t j = 0; j < z; j++)
+			P[j].base = static_cast<uint32_t>((P[j].f1 + d0 * P[j].f2) % m);
+		for (size_t j = 0; j < z && distinct; j++) {
+			for (size_t i = 0; i < j && distinct; i++)
+				distinct = P[i].base != P[j].base;
+		}
+		if (!distinct) {
+			++*collisions;
+			continue;
+		}
+
+		for (size_t d1 = 0; d1 < m; d1++) {
+			size_t j;
+
+			++*attempts;
+			for (j = 0; j < z; j++) {
+				size_t f = P[j].base + d1;
+
+				if (phf_isset(T, (f >= m)? f - m : f))
+					break;
+			}
+			if (j == z) {
+				*D = static_cast<uint32_t>(d0 * m + d1);
+				return true;
+			}
+			++*collisions;
+		}
+	}
+
+	return false;
+} /* phf_pair_search() */
+
+template<int layout, bool nodiv, typename key_t>
+inline uint32_t phf_init_f(uint32_t d, const phf_key<key_t> *key, uint32_t seed, size_t m, unsigned pbits, size_t mp) {
+	return (layout == PHF_LAYOUT_PART)? phf_part_f(d, key->k, seed, key->h, pbits, mp)
+	     : (layout == PHF_LAYOUT_SKEW)? phf_skew_f(d, key->k, seed, m)
+	     : phf_f_mod_m<nodiv>(d, key->k, seed, m);
+} /* phf_init_f() */
+
+/* with PHF_LAYOUT_PART, span is the number of buckets per partition */
+template<typename key_t, bool nodiv, int layout = PHF_LAYOUT_FLAT>
+int phf_init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc, const struct phf_allocator *scratch, const size_t span = 0) {
 	size_t n1 = PHF_MAX(n, 1); /* for computations that require n > 0 */
 	size_t l1 = PHF_MAX(l, 1);
 	size_t a1 = PHF_MAX(PHF_MIN(a, 100), 1);
 	size_t r; /* number of buckets */
 	size_t m; /* size of output array */
+	unsigned pbits = 0; /* log2 of number of partitions */
+	size_t rp = 0, mp = 0; /* buckets and slots per partition */
 	phf_key<key_t> *B_k = NULL; /* linear bucket-slot array */
 	size_t *B_z = NULL;         /* number of slots per bucket */
 	phf_key<key_t> *B_p, *B_pe;
 	phf_bits_t *T = NULL; /* bitmap to track index occupancy */
 	phf_bits_t *T_b;      /* per-bucket working bitmap */
-	size_t T_n;
+	size_t T_n = 0;
 	uint32_t *g = NULL; /* displacement map */
 	uint32_t d_max = 0; /* maximum displacement value */
+	phf_hash_t *I = NULL; /* optional slot-to-key-index map */
+	uint64_t attempts = 0, collisions = 0;
+	std::chrono::steady_clock::time_point t0, t1, t2, t3, t4;
+	const bool part = layout == PHF_LAYOUT_PART, skew = layout == PHF_LAYOUT_SKEW, pair = layout == PHF_LAYOUT_PAIR;
+	struct phf_pair *P = NULL; /* keys of the current bucket, with pair */
+	size_t P_n = 0;
 	int error;
 
-	if ((phf->nodiv = nodiv)) {
+	if (stats)
+		t0 = std::chrono::steady_clock::now();
+
+	phf->nodiv = nodiv;
+
+	if (layout == PHF_LAYOUT_FLAT || pair) {
+		if (!(error = phf_tiny(phf, k, n, a, nodiv, seed, stats, index))) {
+			if (stats) {
+				stats->t_hash = stats->t_sort = 0;
+				stats->t_search = stats->t_total = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+			}
+			phf->alloc = alloc;
+			return 0;
+		} else if (error != ERANGE) {
+			return error;
+		}
+	}
+
+	if (part) {
+		/* m is known once we've counted the keys of each partition */
+		rp = PHF_MIN(phf_powerup(PHF_MAX(span, 1)), phf_powerup(n1 / PHF_MIN(l1, n1)));
+		while (pbits < 31 && (rp << pbits) * l1 < n1)
+			pbits++;
+		r = rp << pbits;
+		m = 1;
+	} else if (skew) {
+		/* neither r nor m is used as a divisor, so neither is rounded */
+		r = PHF_MAX(PHF_HOWMANY(n1, l1), 2);
+		m = (n1 * 100) / a1;
+		if (r > PHF_HASH_MAX / 2 || m > PHF_HASH_MAX)
+			return ERANGE;
+	} else if (nodiv) {
 		/* round to power-of-2 so we can use bit masks instead of modulo division */
 		r = phf_powerup(n1 / PHF_MIN(l1, n1));
 		m = phf_powerup((n1 * 100) / a1);
@@ -754,27 +2194,86 @@ template<typename key_t, bool nodiv>
 		m = phf_primeup((n1 * 100) / a1);
 	}
 
+	if (pair) {
+		/* f2 needs m >= 2, and D >> pbits a shift of less than 32 */
+		m = PHF_MAX(m, 2);
+		if (m > PHF_HASH_MAX)
+			return ERANGE;
+		while (nodiv && ((size_t)1 << pbits) < m)
+			pbits++;
+	}
+
 	if (r == 0 || m == 0)
 		return ERANGE;
+	if (index && n >= PHF_INDEX_NONE)
+		return ERANGE; /* key indices must fit in phf_hash_t */
 
-	if ((error = phf_calloc(&B_k, n1)))
+	if ((error = phf_calloc(&B_k, n1, scratch)))
 		goto error;
-	if (!(B_z = static_cast<size_t *>(calloc(r, sizeof *B_z))))
+	if (!(B_z = static_cast<size_t *>(phf_zalloc(scratch, r, sizeof *B_z))))
 		goto syerr;
 
 	for (size_t i = 0; i < n; i++) {
-		phf_hash_t g = phf_g_mod_r<nodiv>(k[i], seed, r);
+		phf_hash_t h = phf_g(k[i], seed);
+		phf_hash_t g = (part)? (phf_part_of(h, pbits) * rp + (h & (rp - 1))) : (skew)? phf_skew_g(h, r) : (nodiv)? (h & (r - 1)) : (h % r);
 
 		B_k[i].k = k[i];
 		B_k[i].g = g;
+		B_k[i].h = h;
+		B_k[i].i = static_cast<phf_hash_t>(i);
 		B_k[i].n = &B_z[g];
 		++*B_k[i].n;
 	}
 
+	if (part) {
+		size_t z_max = 0;
+
+		for (size_t p = 0; p < ((size_t)1 << pbits); p++) {
+			size_t z = 0;
+
+			for (size_t b = p * rp; b < (p + 1) * rp; b++)
+				z += B_z[b];
+			z_max = PHF_MAX(z, z_max);
+		}
+
+		/* the same number of slots for every partition, enough for the fullest */
+		mp = PHF_MAX(PHF_HOWMANY((n1 * 100) / a1, (size_t)1 << pbits), PHF_HOWMANY(z_max * 100, PHF_PART_LOAD));
+		m = mp << pbits;
+		if (m > PHF_HASH_MAX) {
+			error = ERANGE;
+			goto error;
+		}
+	}
+
+	if (pair) {
+		for (size_t b = 0; b < r; b++)
+			P_n = PHF_MAX(B_z[b], P_n);
+		if (!(P = static_cast<struct phf_pair *>(phf_zalloc(scratch, PHF_MAX(P_n, 1), sizeof *P))))
+			goto syerr;
+	}
+
+	if (stats)
+		t1 = std::chrono::steady_clock::now();
+
 	phf_keysort(B_k, n1);
 
+	/* duplicates share g(k), so are adjacent within their bucket */
+	for (B_p = B_k, B_pe = &B_k[n]; B_p < B_pe; B_p++) {
+		for (phf_key<key_t> *Bi_p = B_p + 1; Bi_p < B_pe && Bi_p->g == B_p->g && Bi_p->h == B_p->h; Bi_p++) {
+			if (Bi_p->k == B_p->k) {
+				if (stats)
+					phf_dupstats(stats, k, n, B_p->k);
+				error = EEXIST;
+				goto error;
+			}
+		}
+	}
+
+	if (stats)
+		t2 = std::chrono::steady_clock::now();
+
 	T_n = PHF_HOWMANY(m, PHF_BITS(*T));
-	if (!(T = static_cast<phf_bits_t *>(calloc(T_n * 2, sizeof *T))))
+	if (!(T = static_cast<phf_bits_t *>(phf_zalloc(scratch, T_n * 2, sizeof *T))))
 		goto syerr;
 	T_b = &T[T_n]; /* share single allocation */
 
@@ -788,9 +2287,16 @@ template<typename key_t, bool nodiv>
 	 * end of the outer loop.
 	 */
 
-	if (!(g = static_cast<uint32_t *>(calloc(r, sizeof *g))))
+	if (!(g = static_cast<uint32_t *>(phf_zalloc(alloc, r, sizeof *g))))
 		goto syerr;
 
+	if (index) {
+		if (!(I = static_cast<phf_hash_t *>(malloc(m * sizeof *I))))
+			goto syerr;
+		for (size_t i = 0; i < m; i++)
+			I[i] = PHF_INDEX_NONE;
+	}
+
 	B_p = B_k;
 	B_pe = &B_k[n];
 
@@ -798,21 +2304,47 @@ template<typename key_t, bool nodiv>
 		phf_key<key_t> *Bi_p, *Bi_pe;
 		size_t d = 0;
 		uint32_t f;
+
+		if (pair) {
+			size_t z = *B_p->n;
+			uint32_t D;
+
+			for (size_t j = 0; j < z; j++) {
+				P[j].f1 = phf_pair_f1<nodiv>(phf_f(0, B_p[j].k, seed), m);
+				P[j].f2 = phf_pair_f2<nodiv>(phf_f(1, B_p[j].k, seed), m);
+			}
+			if (!phf_pair_search(&D, P, z, T, m, &attempts, &collisions)) {
+				error = ERANGE;
+				goto error;
+			}
+			for (size_t j = 0; j < z; j++) {
+				f = P[j].base + static_cast<uint32_t>(D % m);
+				f = (f >= m)? static_cast<uint32_t>(f - m) : f;
+				phf_setbit(T, f);
+				if (I)
+					I[f] = B_p[j].i;
+			}
+			g[B_p->g] = D;
+			d_max = PHF_MAX(D, d_max);
+			continue;
+		}
 retry:
 		d++;
+		attempts++;
 		Bi_p = B_p;
 		Bi_pe = B_p + *B_p->n;
 
 		for (; Bi_p < Bi_pe; Bi_p++) {
-			f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
+			f = phf_init_f<layout, nodiv>(d, Bi_p, seed, m, pbits, mp);
 
 			if (phf_isset(T, f) || phf_isset(T_b, f)) {
 				/* reset T_b[] */
 				for (Bi_p = B_p; Bi_p < Bi_pe; Bi_p++) {
-					f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
+					f = phf_init_f<layout, nodiv>(d, Bi_p, seed, m, pbits, mp);
 					phf_clrbit(T_b, f);
 				}
 
+				collisions++;
 				goto retry;
 			} else {
 				phf_setbit(T_b, f);
@@ -821,8 +2353,10 @@ retry:
 
 		/* commit to T[] */
 		for (Bi_p = B_p; Bi_p < Bi_pe; Bi_p++) {
-			f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
+			f = phf_init_f<layout, nodiv>(d, Bi_p, seed, m, pbits, mp);
 			phf_setbit(T, f);
+			if (I)
+				I[f] = Bi_p->i;
 		}
 
 		/* commit to g[] */
@@ -830,6 +2364,28 @@ retry:
 		d_max = PHF_MAX(d, d_max);
 	}
 
+	if (stats) {
+		t3 = std::chrono::steady_clock::now();
+		try {
+			phf_fillstats(stats, g, r, B_z, n, d_max);
+		} catch (std::bad_alloc &) {
+			error = ENOMEM;
+			goto error;
+		}
+		stats->attempts = attempts;
+		stats->collisions = collisions;
+		stats->scratch = n1 * sizeof *B_k + r * sizeof *B_z + T_n * 2 * sizeof *T;
+		if (P)
+			stats->scratch += PHF_MAX(P_n, 1) * sizeof *P;
+		if (I)
+			stats->scratch += m * sizeof *I;
+		t4 = std::chrono::steady_clock::now();
+		stats->t_hash = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		stats->t_sort = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+		stats->t_search = std::chrono::duration_cast<std::chrono::nanoseconds>(t3 - t2).count();
+		stats->t_total = std::chrono::duration_cast<std::chrono::nanoseconds>(t4 - t0).count();
+	}
+
 	phf->seed = seed;
 	phf->r = r;
 	phf->m = m;
@@ -838,7 +2394,15 @@ retry:
 	g = NULL;
 
 	phf->d_max = d_max;
-	phf->g_op = (nodiv)? PHF_G_UINT32_BAND_R : PHF_G_UINT32_MOD_R;
+	phf->g_op = (part)? PHF_G_UINT32_PART_R : (skew)? PHF_G_UINT32_SKEW_R : (pair)? ((nodiv)? PHF_G_UINT32_PAIR_BAND_R : PHF_G_UINT32_PAIR_MOD_R) : (nodiv)? PHF_G_UINT32_BAND_R : PHF_G_UINT32_MOD_R;
+	phf->pbits = pbits;
+	phf->g_huge = 0;
+	phf->alloc = alloc;
+
+	if (index) {
+		*index = I;
+		I = NULL;
+	}
 
 	error = 0;
 
@@ -848,14 +2412,82 @@ syerr:
 error:
 	(void)0;
 clean:
-	free(g);
-	free(T);
-	free(B_z);
-	phf_freearray(B_k, n1);
+	free(I);
+	phf_dealloc(alloc, g, r, sizeof *g);
+	phf_dealloc(scratch, P, PHF_MAX(P_n, 1), sizeof *P);
+	phf_dealloc(scratch, T, T_n * 2, sizeof *T);
+	phf_dealloc(scratch, B_z, r, sizeof *B_z);
+	phf_freearray(B_k, n1, scratch);
 
 	return error;
+} /* phf_init() */
+
+template<typename key_t, bool nodiv>
+ int PHF::init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc) {
+	return phf_init<key_t, nodiv>(phf, k, n, l, a, seed, stats, index, alloc, alloc);
 } /* PHF::init() */
 
+/*
+ * Once g outgrows the cache every lookup misses twice, on g and on the
+ * caller's value array. PHF::part_init splits both into 2^pbits
+ * partitions chosen by the high bits of g(k). Partition p owns buckets
+ * [p * rp, (p + 1) * rp) and slots [p * mp, (p + 1) * mp), and its keys
+ * are only ever displaced within them, so the two loads of a lookup hit
+ * two small regions that can be prefetched together. Buckets are
+ * indexed by the low bits of g(k), and f(k) is scaled into mp slots by
+ * multiplication, so mp needn't be a power of 2. Every partition gets
+ * the same mp, enough for the fullest one at PHF_PART_LOAD percent.
+ */
+template<typename key_t>
+phf_error_t PHF::part_init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, const size_t span, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc) {
+	return phf_init<key_t, true, PHF_LAYOUT_PART>(phf, k, n, l, a, seed, stats, index, alloc, alloc, span);
+} /* PHF::part_init() */
+
+/*
+ * Buckets are solved largest first, and a large bucket is cheap to place
+ * while T is nearly empty but costs the most attempts once it fills. The
+ * skewed layout, after PTHash, sends the 60% of keys whose g(k) is below
+ * PHF_SKEW_T to the first 30% of buckets, so those buckets are about
+ * three times as full and are all placed early; the sparse remainder
+ * fills the last slots, where small buckets still find room. For the same
+ * d_max this allows a larger l, i.e. a smaller g. g(k) and f(k) are
+ * mapped onto buckets and slots by multiplication, so r and m are used
+ * as is and the load factor is exactly a percent.
+ */
+template<typename key_t>
+phf_error_t PHF::skew_init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc) {
+	return phf_init<key_t, true, PHF_LAYOUT_SKEW>(phf, k, n, l, a, seed, stats, index, alloc, alloc);
+} /* PHF::skew_init() */
+
+/*
+ * The displacement pairs of the original CHD paper. Each key gets two more
+ * hashes, and bucket i's keys go to slots (f1 + d0 * f2 + d1) mod m. f1
+ * and f2 are computed once per key, and stepping d1 shifts every key of
+ * the bucket by one slot, so a failed candidate costs an add and a bit
+ * test instead of rehashing the bucket. g holds D = d0 * m + d1, which is
+ * on the order of m, so the map rarely compacts below 32 bits, and a
+ * lookup hashes the key three times.
+ *
+ * Two keys of a bucket whose (f1, f2) agree mod m share a base for every
+ * d0, so no D separates them. That happens for a few percent of small key
+ * sets, and only a new seed helps, so the build is repeated with seed + 1,
+ * seed + 2, ... up to PHF_PAIR_SEEDS times.
+ */
+#ifndef PHF_PAIR_SEEDS
+#define PHF_PAIR_SEEDS 64 /* PHF::pair_init: seeds tried before ERANGE */
+#endif
+
+template<typename key_t, bool nodiv>
+phf_error_t PHF::pair_init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc) {
+	int error;
+
+	for (unsigned i = 0; ; i++) {
+		error = phf_init<key_t, nodiv, PHF_LAYOUT_PAIR>(phf, k, n, l, a, static_cast<phf_seed_t>(seed + i), stats, index, alloc, alloc);
+		if (error != ERANGE || i + 1 >= PHF_PAIR_SEEDS)
+			return error;
+	}
+} /* PHF::pair_init() */
+
 
 /*
  * D I S P L A C E M E N T  M A P  C O M P A C T I O N
@@ -866,6 +2498,81 @@ clean:
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+/* element size of g, or 0 if g_op isn't a CHD map */
+inline size_t phf_gsize(uint32_t g_op) {
+	switch (g_op) {
+	case PHF_G_UINT8_MOD_R:
+	case PHF_G_UINT8_BAND_R:
+	case PHF_G_UINT8_PART_R:
+	case PHF_G_UINT8_SKEW_R:
+	case PHF_G_UINT8_PAIR_MOD_R:
+	case PHF_G_UINT8_PAIR_BAND_R:
+		return sizeof (uint8_t);
+	case PHF_G_UINT16_MOD_R:
+	case PHF_G_UINT16_BAND_R:
+	case PHF_G_UINT16_PART_R:
+	case PHF_G_UINT16_SKEW_R:
+	case PHF_G_UINT16_PAIR_MOD_R:
+	case PHF_G_UINT16_PAIR_BAND_R:
+		return sizeof (uint16_t);
+	case PHF_G_UINT32_MOD_R:
+	case PHF_G_UINT32_BAND_R:
+	case PHF_G_UINT32_PART_R:
+	case PHF_G_UINT32_SKEW_R:
+	case PHF_G_UINT32_PAIR_MOD_R:
+	case PHF_G_UINT32_PAIR_BAND_R:
+		return sizeof (uint32_t);
+	default:
+		return 0;
+	}
+} /* phf_gsize() */
+
+/* g_op of the same layout with an element size of width */
+inline uint32_t phf_gresize(uint32_t g_op, size_t width) {
+	static const uint32_t ops[][3] = {
+		{ PHF_G_UINT8_MOD_R, PHF_G_UINT16_MOD_R, PHF_G_UINT32_MOD_R },
+		{ PHF_G_UINT8_BAND_R, PHF_G_UINT16_BAND_R, PHF_G_UINT32_BAND_R },
+		{ PHF_G_UINT8_PART_R, PHF_G_UINT16_PART_R, PHF_G_UINT32_PART_R },
+		{ PHF_G_UINT8_SKEW_R, PHF_G_UINT16_SKEW_R, PHF_G_UINT32_SKEW_R },
+		{ PHF_G_UINT8_PAIR_MOD_R, PHF_G_UINT16_PAIR_MOD_R, PHF_G_UINT32_PAIR_MOD_R },
+		{ PHF_G_UINT8_PAIR_BAND_R, PHF_G_UINT16_PAIR_BAND_R, PHF_G_UINT32_PAIR_BAND_R },
+	};
+	size_t j = (width == sizeof (uint8_t))? 0 : (width == sizeof (uint16_t))? 1 : 2;
+
+	for (size_t i = 0; i < PHF_COUNTOF(ops); i++) {
+		if (g_op == ops[i][0] || g_op == ops[i][1] || g_op == ops[i][2])
+			return ops[i][j];
+	}
+
+	return g_op;
+} /* phf_gresize() */
+
+/* PHF_LAYOUT_* of a function built by phf_init */
+inline int phf_layout(const struct phf *phf) {
+	switch (phf->g_op) {
+	case PHF_G_UINT8_PART_R:
+	case PHF_G_UINT16_PART_R:
+	case PHF_G_UINT32_PART_R:
+		return PHF_LAYOUT_PART;
+	case PHF_G_UINT8_SKEW_R:
+	case PHF_G_UINT16_SKEW_R:
+	case PHF_G_UINT32_SKEW_R:
+		return PHF_LAYOUT_SKEW;
+	case PHF_G_UINT8_PAIR_MOD_R:
+	case PHF_G_UINT8_PAIR_BAND_R:
+	case PHF_G_UINT16_PAIR_MOD_R:
+	case PHF_G_UINT16_PAIR_BAND_R:
+	case PHF_G_UINT32_PAIR_MOD_R:
+	case PHF_G_UINT32_PAIR_BAND_R:
+		return PHF_LAYOUT_PAIR;
+	default:
+		return PHF_LAYOUT_FLAT;
+	}
+} /* phf_layout() */
+
+/* release the whole huge pages of a PHF::hugealloc mapping past size */
+inline void phf_hugetrim(void *p, size_t *len, size_t size);
+
 template<typename dst_t, typename src_t>
 inline void phf_memmove(dst_t *dst, src_t *src, size_t n) {
 	for (size_t i = 0; i < n; i++) {
@@ -876,28 +2583,51 @@ inline void phf_memmove(dst_t *dst, src_t *src, size_t n) {
 
 void PHF::compact(struct phf *phf) {
     size_t size = 0;
-    void *tmp;
+    void *tmp, *dst;
     
     switch (phf->g_op) {
     case PHF_G_UINT32_MOD_R:
     case PHF_G_UINT32_BAND_R:
+    case PHF_G_UINT32_PART_R:
+    case PHF_G_UINT32_SKEW_R:
+    case PHF_G_UINT32_PAIR_MOD_R:
+    case PHF_G_UINT32_PAIR_BAND_R:
 	break;
     default:
 	return; /* already compacted */
     }
     
-    if (phf->d_max <= 255) {
-	phf_memmove(reinterpret_cast<uint8_t *>(phf->g), reinterpret_cast<uint32_t *>(phf->g), phf->r);
-	phf->g_op = (phf->nodiv)? PHF_G_UINT8_BAND_R : PHF_G_UINT8_MOD_R;
+    if (phf->d_max <= 255)
 	size = sizeof (uint8_t);
-    } else if (phf->d_max <= 65535) {
-	phf_memmove(reinterpret_cast<uint16_t *>(phf->g), reinterpret_cast<uint32_t *>(phf->g), phf->r);
-	phf->g_op = (phf->nodiv)? PHF_G_UINT16_BAND_R : PHF_G_UINT16_MOD_R;
+    else if (phf->d_max <= 65535)
 	size = sizeof (uint16_t);
-    } else {
+    else
 	return; /* nothing to compact */
+
+    /* an allocator can't resize, so copy into a new array, if we get one */
+    dst = phf->g;
+    if (phf->alloc && !phf->g_huge && !(dst = phf_zalloc(phf->alloc, phf->r, size)))
+	return;
+
+    if (size == sizeof (uint8_t)) {
+	phf_memmove(static_cast<uint8_t *>(dst), reinterpret_cast<uint32_t *>(phf->g), phf->r);
+	phf->g_op = phf_gresize(phf->g_op, size);
+    } else {
+	phf_memmove(static_cast<uint16_t *>(dst), reinterpret_cast<uint32_t *>(phf->g), phf->r);
+	phf->g_op = phf_gresize(phf->g_op, size);
+    }
+
+    if (dst != phf->g) {
+	phf_dealloc(phf->alloc, phf->g, phf->r, sizeof (uint32_t));
+	phf->g = static_cast<uint32_t *>(dst);
+	return;
     }
     
+    if (phf->g_huge) {
+	phf_hugetrim(phf->g, &phf->g_huge, phf->r * size);
+	return;
+    }
+
     /* simply keep old array if realloc fails */
     if ((tmp = realloc(phf->g, phf->r * size)))
 	phf->g = static_cast<uint32_t *>(tmp);
@@ -905,23 +2635,156 @@ void PHF::compact(struct phf *phf) {
 
 
 /*
- * F U N C T I O N  G E N E R A T O R  &  S T A T E  I N T E R F A C E S
+ * H U G E  P A G E S
+ *
+ * A displacement map of hundreds of MB spans far more 4KB pages than the
+ * TLB covers, so a random lookup usually pays for a page walk on top of
+ * the cache miss. PHF::hugealloc maps memory 2MB aligned, backed by
+ * explicit huge pages (MAP_HUGETLB) if any are reserved, or else advised
+ * for transparent huge pages, or else plain anonymous memory, so callers
+ * never need to handle the absence of huge pages themselves. The length
+ * is rounded up to a whole huge page, so it is meant for large arrays:
+ * displacement maps, through PHF::hugepage, and value arrays.
+ *
+ * A huge-page map is compacted in place and the pages past its new end
+ * are unmapped, instead of calling realloc(3).
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
-template int PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t);
+#ifndef PHF_HUGEPAGE_SIZE
+#define PHF_HUGEPAGE_SIZE ((size_t)2 * 1024 * 1024)
+#endif
 
-template int PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t);
-template int PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t);
+#define PHF_HUGEPAGE_ROUND(n) (PHF_HOWMANY(PHF_MAX((n), (size_t)1), PHF_HUGEPAGE_SIZE) * PHF_HUGEPAGE_SIZE)
 
-template<bool nodiv, typename map_t, typename key_t>
-inline phf_hash_t phf_hash_(map_t *g, key_t k, uint32_t seed, size_t r, size_t m) {
-    if (nodiv) {
+phf_error_t PHF::hugealloc(void **p, const size_t size, const int flags) {
+#if PHF_HAVE_MMAP
+	size_t len = PHF_HUGEPAGE_ROUND(size), head;
+	char *map = static_cast<char *>(MAP_FAILED);
+
+	if (size > SIZE_MAX - 2 * PHF_HUGEPAGE_SIZE)
+		return ENOMEM;
+
+#if defined MAP_HUGETLB
+	if (flags & PHF_HUGEPAGE_EXPLICIT)
+		map = static_cast<char *>(mmap(NULL, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0));
+#endif
+	if (map != MAP_FAILED) {
+		*p = map;
+		return 0;
+	}
+
+	/* over-map by one huge page and trim, so the range is 2MB aligned */
+	if (MAP_FAILED == (map = static_cast<char *>(mmap(NULL, len + PHF_HUGEPAGE_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0))))
+		return errno;
+
+	head = (PHF_HUGEPAGE_SIZE - reinterpret_cast<uintptr_t>(map) % PHF_HUGEPAGE_SIZE) % PHF_HUGEPAGE_SIZE;
+	if (head)
+		munmap(map, head);
+	munmap(map + head + len, PHF_HUGEPAGE_SIZE - head);
+	map += head;
+
+#if defined MADV_HUGEPAGE
+	if (flags & (PHF_HUGEPAGE_TRANSPARENT|PHF_HUGEPAGE_EXPLICIT))
+		(void)madvise(map, len, MADV_HUGEPAGE); /* only a hint */
+#endif
+
+	*p = map;
+
+	return 0;
+#else
+	(void)flags;
+
+	if (!(*p = calloc(1, PHF_MAX(size, 1))))
+		return errno;
+
+	return 0;
+#endif
+} /* PHF::hugealloc() */
+
+void PHF::hugefree(void *p, const size_t size) {
+	if (!p)
+		return;
+#if PHF_HAVE_MMAP
+	munmap(p, PHF_HUGEPAGE_ROUND(size));
+#else
+	(void)size;
+	free(p);
+#endif
+} /* PHF::hugefree() */
+
+inline void phf_hugetrim(void *p, size_t *len, size_t size) {
+#if PHF_HAVE_MMAP
+	size_t keep = PHF_HUGEPAGE_ROUND(size), have = PHF_HUGEPAGE_ROUND(*len);
+
+	if (keep < have && 0 == munmap(static_cast<char *>(p) + keep, have - keep))
+		*len = keep;
+#else
+	(void)p; (void)len; (void)size;
+#endif
+} /* phf_hugetrim() */
+
+phf_error_t PHF::hugepage(struct phf *phf, const int flags) {
+	size_t size = phf->r * phf_gsize(phf->g_op);
+	void *g;
+	int error;
+
+	if (!phf->g || phf->g_huge)
+		return 0;
+	if (!size)
+		return EINVAL;
+	if (size < PHF_HUGEPAGE_SIZE / 2)
+		return 0; /* the map already fits in a few small pages */
+
+	if ((error = PHF::hugealloc(&g, size, flags)))
+		return error;
+	memcpy(g, phf->g, size);
+
+	PHF::destroy(phf);
+	phf->g = static_cast<uint32_t *>(g);
+	phf->g_huge = size;
+
+	return 0;
+} /* PHF::hugepage() */
+
+
+/*
+ * F U N C T I O N  G E N E R A T O R  &  S T A T E  I N T E R F A C E S
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+template int PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template int PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template int PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template phf_error_t PHF::part_init<uint32_t>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::part_init<uint64_t>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::part_init<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::part_init<std::string>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::skew_init<uint32_t>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::skew_init<uint64_t>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::skew_init<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::skew_init<std::string>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template phf_error_t PHF::pair_init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template phf_error_t PHF::pair_init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::pair_init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template<bool nodiv, typename map_t, typename key_t>
+inline phf_hash_t phf_hash_(map_t g, key_t k, uint32_t seed, size_t r, size_t m) {
+    if (nodiv) {
 	uint32_t d = g[phf_g(k, seed) & (r - 1)];
 	
 	return phf_f(d, k, seed) & (m - 1);
@@ -932,25 +2795,104 @@ inline phf_hash_t phf_hash_(map_t *g, key_t k, uint32_t seed, size_t r, size_t m
     }
 } /* phf_hash_() */
 
+template<typename map_t, typename key_t>
+inline phf_hash_t phf_hash_part_(map_t g, key_t k, uint32_t seed, size_t r, size_t m, unsigned pbits) {
+    uint32_t h = phf_g(k, seed);
+    size_t rp = r >> pbits;
+    uint32_t d = g[phf_part_of(h, pbits) * rp + (h & (rp - 1))];
+
+    return phf_part_f(d, k, seed, h, pbits, m >> pbits);
+} /* phf_hash_part_() */
+
+template<typename map_t, typename key_t>
+inline phf_hash_t phf_hash_skew_(map_t g, key_t k, uint32_t seed, size_t r, size_t m) {
+    uint32_t d = g[phf_skew_g(phf_g(k, seed), r)];
+
+    return phf_skew_f(d, k, seed, m);
+} /* phf_hash_skew_() */
+
+template<bool nodiv, typename map_t, typename key_t>
+inline phf_hash_t phf_hash_pair_(map_t g, key_t k, uint32_t seed, size_t r, size_t m, unsigned pbits) {
+    uint32_t D = g[phf_g_mod_r<nodiv>(k, seed, r)];
+
+    return phf_pair_pos<nodiv>(phf_f(0, k, seed), phf_f(1, k, seed), D, m, pbits);
+} /* phf_hash_pair_() */
+
+/* dispatch on g_op; shared by PHF::hash and PHF::pack_hash */
 template<typename T>
- phf_hash_t PHF::hash(const struct phf *phf, T k) {
-    switch (phf->g_op) {
+inline phf_hash_t phf_hash_op(uint32_t g_op, const void *g, T k, uint32_t seed, size_t r, size_t m, unsigned pbits) {
+    switch (g_op) {
+    case PHF_G_NONE_BAND_M:
+	return phf_g(k, seed) & (m - 1);
     case PHF_G_UINT8_MOD_R:
-	return phf_hash_<false>(reinterpret_cast<uint8_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<false>(static_cast<const uint8_t *>(g), k, seed, r, m);
     case PHF_G_UINT8_BAND_R:
-	return phf_hash_<true>(reinterpret_cast<uint8_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<true>(static_cast<const uint8_t *>(g), k, seed, r, m);
     case PHF_G_UINT16_MOD_R:
-	return phf_hash_<false>(reinterpret_cast<uint16_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<false>(static_cast<const uint16_t *>(g), k, seed, r, m);
     case PHF_G_UINT16_BAND_R:
-	return phf_hash_<true>(reinterpret_cast<uint16_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<true>(static_cast<const uint16_t *>(g), k, seed, r, m);
+    case PHF_G_UINT32_MOD_R:
+	return phf_hash_<false>(static_cast<const uint32_t *>(g), k, seed, r, m);
+    case PHF_G_UINT32_BAND_R:
+	return phf_hash_<true>(static_cast<const uint32_t *>(g), k, seed, r, m);
+    case PHF_G_UINT8_PART_R:
+	return phf_hash_part_(static_cast<const uint8_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT16_PART_R:
+	return phf_hash_part_(static_cast<const uint16_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT32_PART_R:
+	return phf_hash_part_(static_cast<const uint32_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT8_SKEW_R:
+	return phf_hash_skew_(static_cast<const uint8_t *>(g), k, seed, r, m);
+    case PHF_G_UINT16_SKEW_R:
+	return phf_hash_skew_(static_cast<const uint16_t *>(g), k, seed, r, m);
+    case PHF_G_UINT32_SKEW_R:
+	return phf_hash_skew_(static_cast<const uint32_t *>(g), k, seed, r, m);
+    case PHF_G_UINT8_PAIR_MOD_R:
+	return phf_hash_pair_<false>(static_cast<const uint8_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT8_PAIR_BAND_R:
+	return phf_hash_pair_<true>(static_cast<const uint8_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT16_PAIR_MOD_R:
+	return phf_hash_pair_<false>(static_cast<const uint16_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT16_PAIR_BAND_R:
+	return phf_hash_pair_<true>(static_cast<const uint16_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT32_PAIR_MOD_R:
+	return phf_hash_pair_<false>(static_cast<const uint32_t *>(g), k, seed, r, m, pbits);
+    case PHF_G_UINT32_PAIR_BAND_R:
+	return phf_hash_pair_<true>(static_cast<const uint32_t *>(g), k, seed, r, m, pbits);
+    default:
+	abort();
+	return 0;
+    }
+} /* phf_hash_op() */
+
+/* as phf_hash_op, but g is one of the PHF_ENC_* decoders and g_op is a UINT32 op */
+template<typename map_t, typename T>
+inline phf_hash_t phf_hash_dec(uint32_t g_op, map_t g, T k, uint32_t seed, size_t r, size_t m, unsigned pbits) {
+    switch (g_op) {
+    case PHF_G_NONE_BAND_M:
+	return phf_g(k, seed) & (m - 1);
     case PHF_G_UINT32_MOD_R:
-	return phf_hash_<false>(reinterpret_cast<uint32_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<false>(g, k, seed, r, m);
     case PHF_G_UINT32_BAND_R:
-	return phf_hash_<true>(reinterpret_cast<uint32_t *>(phf->g), k, phf->seed, phf->r, phf->m);
+	return phf_hash_<true>(g, k, seed, r, m);
+    case PHF_G_UINT32_PART_R:
+	return phf_hash_part_(g, k, seed, r, m, pbits);
+    case PHF_G_UINT32_SKEW_R:
+	return phf_hash_skew_(g, k, seed, r, m);
+    case PHF_G_UINT32_PAIR_MOD_R:
+	return phf_hash_pair_<false>(g, k, seed, r, m, pbits);
+    case PHF_G_UINT32_PAIR_BAND_R:
+	return phf_hash_pair_<true>(g, k, seed, r, m, pbits);
     default:
 	abort();
 	return 0;
     }
+} /* phf_hash_dec() */
+
+template<typename T>
+ phf_hash_t PHF::hash(const struct phf *phf, T k) {
+    return phf_hash_op(phf->g_op, phf->g, k, phf->seed, phf->r, phf->m, phf->pbits);
 } /* PHF::hash() */
 
 template phf_hash_t PHF::hash<uint32_t>(const struct phf *, uint32_t);
@@ -959,9 +2901,3193 @@ template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, phf_string_t);
 template phf_hash_t PHF::hash<std::string>(const struct phf *, std::string);
 
 void PHF::destroy(struct phf *phf) {
-	free(phf->g);
+	if (phf->g_huge)
+		PHF::hugefree(phf->g, phf->g_huge);
+	else
+		phf_dealloc(phf->alloc, phf->g, phf->r, phf_gsize(phf->g_op));
 	phf->g = NULL;
+	phf->g_huge = 0;
 } /* PHF::destroy() */
 
 
+/*
+ * R E U S A B L E  B U I L D E R
+ *
+ * PHF::build is PHF::init with the scratch arrays served from a struct
+ * phf_builder. Its few blocks are handed out best fit and only replaced
+ * when a block is too small, so after the largest key set has been seen
+ * building costs no allocations beyond g itself, apart from copies of
+ * std::string keys too long for the small string buffer.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+inline void *phf_builder_allocate(void *ctx, size_t size, size_t align) {
+	struct phf_builder *b = static_cast<struct phf_builder *>(ctx);
+	struct phf_builder_block *fit = NULL, *spare = NULL;
+	void *p;
+
+	(void)align; /* malloc(3) memory is aligned for any scalar */
+
+	for (size_t i = 0; i < PHF_COUNTOF(b->block); i++) {
+		struct phf_builder_block *blk = &b->block[i];
+
+		if (blk->used)
+			continue;
+		if (blk->size >= size) {
+			if (!fit || blk->size < fit->size)
+				fit = blk;
+		} else if (!spare || blk->size < spare->size) {
+			spare = blk;
+		}
+	}
+
+	if (!fit) {
+		if (!spare)
+			return malloc(size); /* every block in use */
+		if (!(p = malloc(size)))
+			return NULL;
+		free(spare->p);
+		spare->p = p;
+		spare->size = size;
+		fit = spare;
+	}
+
+	fit->used = true;
+
+	return fit->p;
+} /* phf_builder_allocate() */
+
+inline void phf_builder_deallocate(void *ctx, void *p, size_t, size_t) {
+	struct phf_builder *b = static_cast<struct phf_builder *>(ctx);
+
+	for (size_t i = 0; i < PHF_COUNTOF(b->block); i++) {
+		if (b->block[i].used && b->block[i].p == p) {
+			b->block[i].used = false;
+			return;
+		}
+	}
+
+	free(p);
+} /* phf_builder_deallocate() */
+
+template<typename key_t, bool nodiv>
+phf_error_t PHF::build(struct phf_builder *b, struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, struct phf_stats *stats, phf_hash_t **index, const struct phf_allocator *alloc) {
+	struct phf_allocator scratch;
+
+	scratch.allocate = &phf_builder_allocate;
+	scratch.deallocate = &phf_builder_deallocate;
+	scratch.ctx = b;
+
+	return phf_init<key_t, nodiv>(phf, k, n, l, a, seed, stats, index, alloc, &scratch);
+} /* PHF::build() */
+
+void PHF::builder_destroy(struct phf_builder *b) {
+	for (size_t i = 0; i < PHF_COUNTOF(b->block); i++) {
+		free(b->block[i].p);
+		b->block[i].p = NULL;
+		b->block[i].size = 0;
+		b->block[i].used = false;
+	}
+} /* PHF::builder_destroy() */
+
+template phf_error_t PHF::build<uint32_t, true>(struct phf_builder *, struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<uint64_t, true>(struct phf_builder *, struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<phf_string_t, true>(struct phf_builder *, struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<std::string, true>(struct phf_builder *, struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+template phf_error_t PHF::build<uint32_t, false>(struct phf_builder *, struct phf *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<uint64_t, false>(struct phf_builder *, struct phf *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<phf_string_t, false>(struct phf_builder *, struct phf *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+template phf_error_t PHF::build<std::string, false>(struct phf_builder *, struct phf *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, struct phf_stats *, phf_hash_t **, const struct phf_allocator *);
+
+
+/*
+ * B A T C H  C O N S T R U C T I O N
+ *
+ * PHF::batch_init builds one function per key range of a CSR layout:
+ * function i covers k[off[i]] up to k[off[i + 1]]. Threads claim short
+ * runs of functions from a shared counter, so a few large key sets don't
+ * leave the other threads idle, and each keeps a struct phf_builder, so
+ * neither the scratch arrays nor g cost an allocation per function. g is
+ * staged per thread, then every map is copied, at the width its d_max
+ * allows, into one array in function order. Neighbouring functions thus
+ * share cache lines and pages, and the whole batch is freed at once.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define PHF_BATCH_RUN 64 /* functions claimed at a time */
+
+inline size_t phf_batch_width(const struct phf *phf) {
+	if (phf->g_op == PHF_G_NONE_BAND_M)
+		return 0;
+	else if (phf->d_max <= 255)
+		return sizeof (uint8_t);
+	else if (phf->d_max <= 65535)
+		return sizeof (uint16_t);
+	else
+		return sizeof (uint32_t);
+} /* phf_batch_width() */
+
+template<typename key_t, bool nodiv>
+phf_error_t PHF::batch_init(struct phf_batch *batch, const key_t k[], const size_t off[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, const unsigned threads, size_t *failed) {
+	const unsigned nthreads = PHF_MAX(threads, 1);
+	struct phf *f = NULL;
+	std::vector<std::vector<uint32_t> > stage;
+	std::vector<unsigned> owner;
+	std::vector<size_t> where; /* offset of each map in stage[owner[i]] */
+	std::vector<size_t> goff;  /* offset of each map in g */
+	std::atomic<size_t> next(0);
+	std::atomic<bool> stop(false);
+	std::vector<int> error;
+	std::vector<size_t> bad;
+	char *g = NULL;
+	size_t size = 0;
+	unsigned first = nthreads;
+
+	try {
+		stage.resize(nthreads);
+		owner.resize(n);
+		where.resize(n);
+		goff.resize(n);
+		error.resize(nthreads, 0);
+		bad.resize(nthreads, 0);
+	} catch (std::bad_alloc &) {
+		return ENOMEM;
+	}
+
+	if (phf_calloc(&f, PHF_MAX(n, 1)))
+		return ENOMEM;
+
+	phf_prun(nthreads, [&](unsigned t) {
+		struct phf_builder b;
+		struct phf_allocator scratch;
+		size_t i;
+
+		scratch.allocate = &phf_builder_allocate;
+		scratch.deallocate = &phf_builder_deallocate;
+		scratch.ctx = &b;
+
+		while (!stop.load(std::memory_order_relaxed) && (i = next.fetch_add(PHF_BATCH_RUN)) < n) {
+			for (size_t j = i; j < PHF_MIN(i + PHF_BATCH_RUN, n) && !error[t]; j++) {
+				struct phf tmp;
+
+				if ((error[t] = phf_init<key_t, nodiv>(&tmp, &k[off[j]], off[j + 1] - off[j], l, a, seed, NULL, NULL, &scratch, &scratch))) {
+					bad[t] = j;
+					break;
+				}
+
+				try {
+					where[j] = stage[t].size();
+					stage[t].insert(stage[t].end(), tmp.g, tmp.g + tmp.r);
+				} catch (std::bad_alloc &) {
+					error[t] = ENOMEM;
+					bad[t] = j;
+				}
+				owner[j] = t;
+
+				f[j] = tmp;
+				f[j].g = NULL;
+				f[j].alloc = NULL;
+				PHF::destroy(&tmp);
+			}
+
+			if (error[t])
+				stop.store(true, std::memory_order_relaxed);
+		}
+
+		PHF::builder_destroy(&b);
+	});
+
+	/*
+	 * Runs are claimed in order and finished even after another thread
+	 * fails, so every function below the lowest failure was built and
+	 * the report doesn't depend on scheduling.
+	 */
+	for (unsigned t = 0; t < nthreads; t++) {
+		if (error[t] && (first == nthreads || bad[t] < bad[first]))
+			first = t;
+	}
+
+	if (first < nthreads) {
+		if (failed)
+			*failed = bad[first];
+		phf_freearray(f, PHF_MAX(n, 1));
+		return error[first];
+	}
+
+	/* lay the maps out in function order, each aligned to its width */
+	for (size_t i = 0; i < n; i++) {
+		size_t width = phf_batch_width(&f[i]);
+
+		if (!width)
+			continue;
+		size = PHF_HOWMANY(size, width) * width;
+		goff[i] = size;
+		size += f[i].r * width;
+	}
+
+	if (!(g = static_cast<char *>(malloc(PHF_MAX(size, 1))))) {
+		phf_freearray(f, PHF_MAX(n, 1));
+		return errno;
+	}
+
+	phf_prun(nthreads, [&](unsigned t) {
+		for (size_t i = n * t / nthreads; i < n * (t + 1) / nthreads; i++) {
+			const uint32_t *src = stage[owner[i]].data() + where[i];
+			char *dst = g + goff[i];
+
+			switch (phf_batch_width(&f[i])) {
+			case sizeof (uint8_t):
+				phf_memmove(reinterpret_cast<uint8_t *>(dst), src, f[i].r);
+				f[i].g_op = (nodiv)? PHF_G_UINT8_BAND_R : PHF_G_UINT8_MOD_R;
+				break;
+			case sizeof (uint16_t):
+				phf_memmove(reinterpret_cast<uint16_t *>(dst), src, f[i].r);
+				f[i].g_op = (nodiv)? PHF_G_UINT16_BAND_R : PHF_G_UINT16_MOD_R;
+				break;
+			case sizeof (uint32_t):
+				memcpy(dst, src, f[i].r * sizeof *src);
+				break;
+			default:
+				continue; /* no map */
+			}
+
+			f[i].g = reinterpret_cast<uint32_t *>(dst);
+		}
+	});
+
+	batch->n = n;
+	batch->f = f;
+	batch->g = g;
+	batch->size = size;
+
+	return 0;
+} /* PHF::batch_init() */
+
+void PHF::batch_destroy(struct phf_batch *batch) {
+	phf_freearray(batch->f, PHF_MAX(batch->n, 1));
+	free(batch->g);
+	batch->n = 0;
+	batch->f = NULL;
+	batch->g = NULL;
+	batch->size = 0;
+} /* PHF::batch_destroy() */
+
+template phf_error_t PHF::batch_init<uint32_t, true>(struct phf_batch *, const uint32_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<uint64_t, true>(struct phf_batch *, const uint64_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<phf_string_t, true>(struct phf_batch *, const phf_string_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<std::string, true>(struct phf_batch *, const std::string[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+
+template phf_error_t PHF::batch_init<uint32_t, false>(struct phf_batch *, const uint32_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<uint64_t, false>(struct phf_batch *, const uint64_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<phf_string_t, false>(struct phf_batch *, const phf_string_t[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+template phf_error_t PHF::batch_init<std::string, false>(struct phf_batch *, const std::string[], const size_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned, size_t *);
+
+
+/*
+ * I N C R E M E N T A L  R E B U I L D
+ *
+ * PHF::rebuild updates a function for a changed key set. The seed, r, m
+ * and the displacement of every bucket that gained no key are kept.
+ * Removing a key only frees its slot, so only buckets that received a new
+ * key are searched again, around the slots still held by the others.
+ *
+ * A bucket placed late into a nearly full table can need far more attempts
+ * than it did during PHF::init, where the largest buckets went first. So
+ * the search is given a budget of n attempts in total, a fraction of what
+ * PHF::init spends, and if it runs out, or the new set would exceed the
+ * load factor within m slots, we fall back to a full PHF::init with the
+ * same seed. A compacted map is widened if a new displacement needs it.
+ *
+ * struct phf doesn't retain keys, so the occupied slots are found by
+ * hashing the retained keys once. That pass streams; the sort and the
+ * displacement search only cover the touched buckets.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+inline void phf_gset(struct phf *phf, size_t i, uint32_t d) {
+	switch (phf_gsize(phf->g_op)) {
+	case sizeof (uint8_t):
+		reinterpret_cast<uint8_t *>(phf->g)[i] = static_cast<uint8_t>(d);
+		break;
+	case sizeof (uint16_t):
+		reinterpret_cast<uint16_t *>(phf->g)[i] = static_cast<uint16_t>(d);
+		break;
+	default:
+		phf->g[i] = d;
+		break;
+	}
+} /* phf_gset() */
+
+/* switch g to an element type that can hold d_max */
+inline phf_error_t phf_gwiden(struct phf *phf, uint32_t d_max) {
+	size_t width = phf_gsize(phf->g_op), g_huge = 0;
+	uint32_t *g;
+	int error;
+
+	if ((width == sizeof (uint8_t) && d_max <= 255) || (width == sizeof (uint16_t) && d_max <= 65535) || width == sizeof (uint32_t))
+		return 0;
+
+	if (phf->g_huge) {
+		g_huge = phf->r * sizeof *g;
+		if ((error = PHF::hugealloc(reinterpret_cast<void **>(&g), g_huge)))
+			return error;
+	} else if (!(g = static_cast<uint32_t *>(phf_zalloc(phf->alloc, phf->r, sizeof *g)))) {
+		return errno;
+	}
+
+	for (size_t i = 0; i < phf->r; i++)
+		g[i] = (width == sizeof (uint8_t))? reinterpret_cast<uint8_t *>(phf->g)[i] : reinterpret_cast<uint16_t *>(phf->g)[i];
+
+	PHF::destroy(phf);
+	phf->g = g;
+	phf->g_huge = g_huge;
+	phf->g_op = (phf->nodiv)? PHF_G_UINT32_BAND_R : PHF_G_UINT32_MOD_R;
+
+	/* back down to 16 bits if that suffices */
+	if (d_max <= 65535) {
+		phf->d_max = d_max;
+		PHF::compact(phf);
+	}
+
+	return 0;
+} /* phf_gwiden() */
+
+/* returns ERANGE if the touched buckets can't be re-solved in place */
+template<typename key_t, bool nodiv>
+phf_error_t phf_resolve(struct phf *phf, const key_t k[], const size_t n, const key_t add[], const size_t nadd, const size_t a) {
+	size_t a1 = PHF_MAX(PHF_MIN(a, 100), 1);
+	size_t width = phf_gsize(phf->g_op);
+	size_t r = phf->r, m = phf->m;
+	size_t budget = PHF_MAX(n, 4096); /* displacement attempts */
+	phf_bits_t *U = NULL; /* buckets which gained a key */
+	phf_bits_t *T = NULL; /* slots held by untouched buckets */
+	phf_bits_t *T_b;      /* per-bucket working bitmap */
+	size_t T_n;
+	phf_key<key_t> *B_k = NULL, *B_p, *B_pe;
+	size_t *B_z = NULL;
+	size_t B_n = 0; /* keys in touched buckets */
+	uint32_t *D = NULL; /* new displacement per touched bucket, in sort order */
+	size_t D_n = 0;
+	uint32_t d_max = static_cast<uint32_t>(phf->d_max);
+	int error;
+
+	if (phf->g_op == PHF_G_NONE_BAND_M || phf_layout(phf) != PHF_LAYOUT_FLAT)
+		return ERANGE; /* no displacement map to patch, or not a flat one */
+	if (!width)
+		return EINVAL;
+	if (n == 0 || (n * 100) / a1 > m)
+		return ERANGE;
+
+	T_n = PHF_HOWMANY(m, PHF_BITS(*T));
+	if (!(T = static_cast<phf_bits_t *>(phf_zalloc(phf->alloc, T_n * 2, sizeof *T))))
+		goto syerr;
+	T_b = &T[T_n];
+	if (!(U = static_cast<phf_bits_t *>(phf_zalloc(phf->alloc, PHF_HOWMANY(r, PHF_BITS(*U)), sizeof *U))))
+		goto syerr;
+	if (!(B_z = static_cast<size_t *>(phf_zalloc(phf->alloc, r, sizeof *B_z))))
+		goto syerr;
+
+	for (size_t i = 0; i < nadd; i++)
+		phf_setbit(U, phf_g_mod_r<nodiv>(add[i], phf->seed, r));
+
+	/* claim the slots of untouched buckets and size the touched ones */
+	for (size_t i = 0; i < n; i++) {
+		phf_hash_t g = phf_g_mod_r<nodiv>(k[i], phf->seed, r);
+		phf_hash_t f;
+
+		if (phf_isset(U, g)) {
+			B_z[g]++;
+			B_n++;
+			continue;
+		}
+
+		f = PHF::hash(phf, k[i]);
+		if (phf_isset(T, f)) {
+			/* k has a duplicate, or a new key missing from add */
+			error = ERANGE;
+			goto error;
+		}
+		phf_setbit(T, f);
+	}
+
+	if ((error = phf_calloc(&B_k, PHF_MAX(B_n, 1), phf->alloc)))
+		goto error;
+	if (!(D = static_cast<uint32_t *>(phf_zalloc(phf->alloc, PHF_MAX(B_n, 1), sizeof *D))))
+		goto syerr;
+
+	for (size_t i = 0, j = 0; i < n && j < B_n; i++) {
+		phf_hash_t h = phf_g(k[i], phf->seed);
+		phf_hash_t g = (nodiv)? (h & (r - 1)) : (h % r);
+
+		if (!phf_isset(U, g))
+			continue;
+
+		B_k[j].k = k[i];
+		B_k[j].g = g;
+		B_k[j].h = h;
+		B_k[j].i = static_cast<phf_hash_t>(i);
+		B_k[j].n = &B_z[g];
+		j++;
+	}
+
+	phf_keysort(B_k, B_n);
+
+	for (B_p = B_k, B_pe = &B_k[B_n]; B_p < B_pe; B_p++) {
+		for (phf_key<key_t> *Bi_p = B_p + 1; Bi_p < B_pe && Bi_p->g == B_p->g && Bi_p->h == B_p->h; Bi_p++) {
+			if (Bi_p->k == B_p->k) {
+				error = EEXIST;
+				goto error;
+			}
+		}
+	}
+
+	for (B_p = B_k; B_p < B_pe; B_p += *B_p->n) {
+		phf_key<key_t> *Bi_p = B_p, *Bi_pe = B_p + *B_p->n;
+		size_t d;
+		uint32_t f;
+
+		for (d = 1; d <= UINT32_MAX && budget > 0; d++, budget--) {
+			for (Bi_p = B_p; Bi_p < Bi_pe; Bi_p++) {
+				f = phf_f_mod_m<nodiv>(static_cast<uint32_t>(d), Bi_p->k, phf->seed, m);
+				if (phf_isset(T, f) || phf_isset(T_b, f))
+					break;
+				phf_setbit(T_b, f);
+			}
+
+			if (Bi_p == Bi_pe)
+				break;
+
+			/* reset T_b[] up to the key that collided */
+			for (Bi_pe = Bi_p, Bi_p = B_p; Bi_p < Bi_pe; Bi_p++)
+				phf_clrbit(T_b, phf_f_mod_m<nodiv>(static_cast<uint32_t>(d), Bi_p->k, phf->seed, m));
+			Bi_pe = B_p + *B_p->n;
+		}
+
+		if (Bi_p != Bi_pe) {
+			error = ERANGE;
+			goto error;
+		}
+
+		/* T_b[] keeps the bits, so it now holds every placed bucket */
+		D[D_n++] = static_cast<uint32_t>(d);
+		d_max = PHF_MAX(d_max, static_cast<uint32_t>(d));
+	}
+
+	if ((error = phf_gwiden(phf, d_max)))
+		goto error;
+
+	/* commit to g[] */
+	for (B_p = B_k, D_n = 0; B_p < B_pe; B_p += *B_p->n)
+		phf_gset(phf, B_p->g, D[D_n++]);
+	phf->d_max = d_max;
+
+	error = 0;
+
+	goto clean;
+syerr:
+	error = errno;
+error:
+	(void)0;
+clean:
+	phf_dealloc(phf->alloc, D, PHF_MAX(B_n, 1), sizeof *D);
+	phf_freearray(B_k, PHF_MAX(B_n, 1), phf->alloc);
+	phf_dealloc(phf->alloc, B_z, r, sizeof *B_z);
+	phf_dealloc(phf->alloc, U, PHF_HOWMANY(r, PHF_BITS(*U)), sizeof *U);
+	phf_dealloc(phf->alloc, T, T_n * 2, sizeof *T);
+
+	return error;
+} /* phf_resolve() */
+
+template<typename key_t>
+phf_error_t PHF::rebuild(struct phf *phf, const key_t k[], const size_t n, const key_t add[], const size_t nadd, const size_t l, const size_t a) {
+	struct phf tmp;
+	int error;
+
+	error = (phf->nodiv)? phf_resolve<key_t, true>(phf, k, n, add, nadd, a) : phf_resolve<key_t, false>(phf, k, n, add, nadd, a);
+	if (error != ERANGE)
+		return error;
+
+	if (phf_layout(phf) == PHF_LAYOUT_PART)
+		error = PHF::part_init<key_t>(&tmp, k, n, l, a, phf->seed, phf->r >> phf->pbits, NULL, NULL, phf->alloc);
+	else if (phf_layout(phf) == PHF_LAYOUT_SKEW)
+		error = PHF::skew_init<key_t>(&tmp, k, n, l, a, phf->seed, NULL, NULL, phf->alloc);
+	else if (phf_layout(phf) == PHF_LAYOUT_PAIR && phf->nodiv)
+		error = PHF::pair_init<key_t, true>(&tmp, k, n, l, a, phf->seed, NULL, NULL, phf->alloc);
+	else if (phf_layout(phf) == PHF_LAYOUT_PAIR)
+		error = PHF::pair_init<key_t, false>(&tmp, k, n, l, a, phf->seed, NULL, NULL, phf->alloc);
+	else if (phf->nodiv)
+		error = PHF::init<key_t, true>(&tmp, k, n, l, a, phf->seed, NULL, NULL, phf->alloc);
+	else
+		error = PHF::init<key_t, false>(&tmp, k, n, l, a, phf->seed, NULL, NULL, phf->alloc);
+	if (error)
+		return error;
+
+	if (phf_gsize(phf->g_op) < sizeof (uint32_t))
+		PHF::compact(&tmp);
+	if (phf->g_huge)
+		(void)PHF::hugepage(&tmp); /* stays on the heap on failure */
+
+	PHF::destroy(phf);
+	*phf = tmp;
+
+	return 0;
+} /* PHF::rebuild() */
+
+template phf_error_t PHF::rebuild<uint32_t>(struct phf *, const uint32_t[], const size_t, const uint32_t[], const size_t, const size_t, const size_t);
+template phf_error_t PHF::rebuild<uint64_t>(struct phf *, const uint64_t[], const size_t, const uint64_t[], const size_t, const size_t, const size_t);
+template phf_error_t PHF::rebuild<phf_string_t>(struct phf *, const phf_string_t[], const size_t, const phf_string_t[], const size_t, const size_t, const size_t);
+template phf_error_t PHF::rebuild<std::string>(struct phf *, const std::string[], const size_t, const std::string[], const size_t, const size_t, const size_t);
+
+
+/*
+ * D Y N A M I C  I N S E R T I O N
+ *
+ * A struct phf_dynamic owns a copy of its keys and the slot-to-key-index
+ * map of its function. A key inserted later takes the next free slot of f,
+ * or else a slot past the end, and is recorded in a small open-addressed
+ * side table keyed by the slot f maps it to, so lookups of the original
+ * keys only pay for an extra probe once the side table isn't empty.
+ *
+ * Once the side table holds limit keys, a thread runs PHF::rebuild on a
+ * snapshot of the keys and the displacement map. The result is swapped in
+ * by the next insert or PHF::dynamic_sync after it finishes, and keys
+ * inserted in the meantime are placed again around the new function.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+template<typename key_t>
+struct phf_dynamic_job {
+	phf_dynamic_job() : done(false), k(NULL), n(0), n_f(0), l(0), a(0), index(NULL), error(0) {}
+
+	std::thread thr;
+	std::atomic<bool> done;
+
+	struct phf f; /* copy of the function being rebuilt */
+	key_t *k;     /* snapshot of the keys */
+	size_t n, n_f;
+	size_t l, a;
+
+	phf_hash_t *index; /* slot-to-key-index map of the new f */
+	int error;
+}; /* struct phf_dynamic_job */
+
+template<typename key_t>
+void phf_dynamic_run(struct phf_dynamic_job<key_t> *job) {
+	int error;
+
+	if ((error = PHF::rebuild(&job->f, job->k, job->n, &job->k[job->n_f], job->n - job->n_f, job->l, job->a)))
+		goto done;
+
+	if (!(job->index = static_cast<phf_hash_t *>(malloc(job->f.m * sizeof *job->index)))) {
+		error = errno;
+		goto done;
+	}
+
+	for (size_t i = 0; i < job->f.m; i++)
+		job->index[i] = PHF_INDEX_NONE;
+	for (size_t i = 0; i < job->n; i++)
+		job->index[PHF::hash(&job->f, job->k[i])] = static_cast<phf_hash_t>(i);
+done:
+	job->error = error;
+	job->done = true;
+} /* phf_dynamic_run() */
+
+template<typename key_t>
+void phf_dynamic_free(struct phf_dynamic_job<key_t> *job) {
+	if (job->thr.joinable())
+		job->thr.join();
+	PHF::destroy(&job->f);
+	if (job->k)
+		phf_freearray(job->k, PHF_MAX(job->n, 1));
+	free(job->index);
+	delete job;
+} /* phf_dynamic_free() */
+
+template<typename key_t>
+phf_error_t phf_dynamic_start(struct phf_dynamic<key_t> *dyn) {
+	struct phf_dynamic_job<key_t> *job;
+	size_t size = dyn->f.r * phf_gsize(dyn->f.g_op);
+	int error;
+
+	if (!(job = new (std::nothrow) phf_dynamic_job<key_t>()))
+		return ENOMEM;
+
+	job->f = dyn->f;
+	job->f.alloc = NULL;
+	job->f.g = NULL;
+	if (dyn->f.g_huge) {
+		/* PHF::rebuild keeps a map in huge pages if it was given one */
+		job->f.g_huge = PHF_MAX(size, 1);
+		if ((error = PHF::hugealloc(reinterpret_cast<void **>(&job->f.g), job->f.g_huge))) {
+			job->f.g_huge = 0;
+			goto error;
+		}
+	} else if (!(job->f.g = static_cast<uint32_t *>(malloc(PHF_MAX(size, 1))))) {
+		error = errno;
+		goto error;
+	}
+	if (size > 0) /* no map for an empty or tiny set */
+		memcpy(job->f.g, dyn->f.g, size);
+
+	if ((error = phf_calloc(&job->k, PHF_MAX(dyn->n, 1))))
+		goto error;
+	std::copy(dyn->k, dyn->k + dyn->n, job->k);
+
+	job->n = dyn->n;
+	job->n_f = dyn->n_f;
+	job->l = dyn->l;
+	job->a = dyn->a;
+
+	try {
+		job->thr = std::thread(phf_dynamic_run<key_t>, job);
+	} catch (...) {
+		error = EAGAIN;
+		goto error;
+	}
+
+	dyn->job = job;
+
+	return 0;
+error:
+	phf_dynamic_free(job);
+
+	return error;
+} /* phf_dynamic_start() */
+
+/* give key i, which f maps to h, a slot and a side table entry */
+template<typename key_t>
+phf_hash_t phf_dynamic_place(struct phf_dynamic<key_t> *dyn, size_t i, phf_hash_t h) {
+	size_t mask = dyn->ov_m - 1, j;
+	phf_hash_t slot;
+
+	while (dyn->cur < dyn->f.m && dyn->index[dyn->cur] != PHF_INDEX_NONE)
+		dyn->cur++;
+
+	if (dyn->cur < dyn->f.m) {
+		slot = static_cast<phf_hash_t>(dyn->cur);
+		dyn->index[slot] = static_cast<phf_hash_t>(i);
+	} else {
+		slot = static_cast<phf_hash_t>(dyn->m++);
+	}
+
+	for (j = h & mask; dyn->ov[j].i != PHF_INDEX_NONE; j = (j + 1) & mask)
+		;;
+
+	dyn->ov[j].h = h;
+	dyn->ov[j].slot = slot;
+	dyn->ov[j].i = static_cast<phf_hash_t>(i);
+	dyn->ov_n++;
+
+	return slot;
+} /* phf_dynamic_place() */
+
+/* make room for one more side table entry */
+template<typename key_t>
+phf_error_t phf_dynamic_grow(struct phf_dynamic<key_t> *dyn) {
+	struct phf_overflow *ov;
+	size_t ov_m;
+
+	if ((dyn->ov_n + 1) * 2 <= dyn->ov_m)
+		return 0;
+
+	ov_m = PHF_MAX(dyn->ov_m * 2, 16);
+	if (!(ov = static_cast<struct phf_overflow *>(malloc(ov_m * sizeof *ov))))
+		return errno;
+
+	for (size_t j = 0; j < ov_m; j++)
+		ov[j].i = PHF_INDEX_NONE;
+
+	for (size_t i = 0; i < dyn->ov_m; i++) {
+		size_t j;
+
+		if (dyn->ov[i].i == PHF_INDEX_NONE)
+			continue;
+
+		for (j = dyn->ov[i].h & (ov_m - 1); ov[j].i != PHF_INDEX_NONE; j = (j + 1) & (ov_m - 1))
+			;;
+		ov[j] = dyn->ov[i];
+	}
+
+	free(dyn->ov);
+	dyn->ov = ov;
+	dyn->ov_m = ov_m;
+
+	return 0;
+} /* phf_dynamic_grow() */
+
+/* swap in a finished rebuild */
+template<typename key_t>
+phf_error_t phf_dynamic_apply(struct phf_dynamic<key_t> *dyn) {
+	struct phf_dynamic_job<key_t> *job = dyn->job;
+	int error;
+
+	job->thr.join();
+	dyn->job = NULL;
+
+	if ((error = job->error)) {
+		phf_dynamic_free(job);
+		return error;
+	}
+
+	PHF::destroy(&dyn->f);
+	dyn->f = job->f;
+	job->f.g = NULL;
+	job->f.g_huge = 0;
+
+	free(dyn->index);
+	dyn->index = job->index;
+	job->index = NULL;
+
+	dyn->n_f = job->n;
+	dyn->m = dyn->f.m;
+	dyn->cur = 0;
+
+	for (size_t j = 0; j < dyn->ov_m; j++)
+		dyn->ov[j].i = PHF_INDEX_NONE;
+	dyn->ov_n = 0;
+
+	/* keys inserted during the rebuild; fewer than before, so no growth */
+	for (size_t i = dyn->n_f; i < dyn->n; i++)
+		phf_dynamic_place(dyn, i, PHF::hash(&dyn->f, dyn->k[i]));
+
+	dyn->epoch++;
+	phf_dynamic_free(job);
+
+	return 0;
+} /* phf_dynamic_apply() */
+
+template<typename key_t, bool nodiv>
+phf_error_t PHF::dynamic_init(struct phf_dynamic<key_t> *dyn, const key_t k[], const size_t n, const size_t l, const size_t a, const phf_seed_t seed, const size_t limit) {
+	struct phf f;
+	phf_hash_t *index = NULL;
+	key_t *keys = NULL;
+	int error;
+
+	if ((error = PHF::init<key_t, nodiv>(&f, k, n, l, a, seed, NULL, &index)))
+		return error;
+	PHF::compact(&f);
+
+	if ((error = phf_calloc(&keys, PHF_MAX(n, 1)))) {
+		free(index);
+		PHF::destroy(&f);
+		return error;
+	}
+	std::copy(k, k + n, keys);
+
+	dyn->f = f;
+	dyn->l = l;
+	dyn->a = a;
+	dyn->k = keys;
+	dyn->n = n;
+	dyn->nk = PHF_MAX(n, 1);
+	dyn->n_f = n;
+	dyn->index = index;
+	dyn->m = f.m;
+	dyn->cur = 0;
+	dyn->ov = NULL;
+	dyn->ov_n = 0;
+	dyn->ov_m = 0;
+	dyn->limit = (limit)? limit : PHF_MAX(n / 64, 64);
+	dyn->epoch = 0;
+	dyn->job = NULL;
+
+	return 0;
+} /* PHF::dynamic_init() */
+
+template<typename key_t>
+phf_error_t PHF::dynamic_insert(struct phf_dynamic<key_t> *dyn, key_t k, phf_hash_t *slot) {
+	phf_hash_t h, s, i;
+	int error;
+
+	if (dyn->job && dyn->job->done)
+		(void)phf_dynamic_apply(dyn); /* on failure the next rebuild retries */
+
+	/* already a key, either of f or in the side table */
+	h = PHF::hash(&dyn->f, k);
+	s = PHF::dynamic_hash(dyn, k);
+	if (s != h || ((i = dyn->index[h]) != PHF_INDEX_NONE && dyn->k[i] == k)) {
+		if (slot)
+			*slot = s;
+		return EEXIST;
+	}
+
+	if (dyn->n >= PHF_INDEX_NONE - 1 || dyn->m >= PHF_HASH_MAX)
+		return ERANGE;
+
+	if (dyn->n == dyn->nk) {
+		key_t *keys;
+
+		if ((error = phf_calloc(&keys, dyn->nk * 2)))
+			return error;
+		std::move(dyn->k, dyn->k + dyn->n, keys);
+		phf_freearray(dyn->k, dyn->nk);
+		dyn->k = keys;
+		dyn->nk *= 2;
+	}
+
+	if ((error = phf_dynamic_grow(dyn)))
+		return error;
+
+	dyn->k[dyn->n] = k;
+	h = phf_dynamic_place(dyn, dyn->n, h);
+	dyn->n++;
+
+	if (slot)
+		*slot = h;
+
+	if (dyn->ov_n >= dyn->limit && !dyn->job)
+		(void)phf_dynamic_start(dyn); /* retried on the next insert */
+
+	return 0;
+} /* PHF::dynamic_insert() */
+
+template<typename key_t>
+phf_hash_t PHF::dynamic_hash(const struct phf_dynamic<key_t> *dyn, key_t k) {
+	phf_hash_t h = PHF::hash(&dyn->f, k);
+
+	if (dyn->ov_n > 0) {
+		size_t mask = dyn->ov_m - 1;
+
+		for (size_t j = h & mask; dyn->ov[j].i != PHF_INDEX_NONE; j = (j + 1) & mask) {
+			if (dyn->ov[j].h == h && dyn->k[dyn->ov[j].i] == k)
+				return dyn->ov[j].slot;
+		}
+	}
+
+	return h;
+} /* PHF::dynamic_hash() */
+
+template<typename key_t>
+phf_error_t PHF::dynamic_sync(struct phf_dynamic<key_t> *dyn, const bool wait) {
+	int error;
+
+	if (dyn->job && (wait || dyn->job->done)) {
+		if ((error = phf_dynamic_apply(dyn)))
+			return error;
+	}
+
+	/* the finished rebuild may predate the latest keys */
+	if (wait && dyn->n > dyn->n_f) {
+		if ((error = phf_dynamic_start(dyn)))
+			return error;
+		return phf_dynamic_apply(dyn);
+	}
+
+	return 0;
+} /* PHF::dynamic_sync() */
+
+template<typename key_t>
+void PHF::dynamic_destroy(struct phf_dynamic<key_t> *dyn) {
+	if (dyn->job) {
+		phf_dynamic_free(dyn->job);
+		dyn->job = NULL;
+	}
+
+	PHF::destroy(&dyn->f);
+	free(dyn->index);
+	dyn->index = NULL;
+	if (dyn->k)
+		phf_freearray(dyn->k, dyn->nk);
+	free(dyn->ov);
+	dyn->ov = NULL;
+	dyn->n = dyn->n_f = dyn->nk = dyn->ov_n = dyn->ov_m = 0;
+} /* PHF::dynamic_destroy() */
+
+template phf_error_t PHF::dynamic_init<uint32_t, true>(struct phf_dynamic<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<uint64_t, true>(struct phf_dynamic<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<phf_string_t, true>(struct phf_dynamic<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<std::string, true>(struct phf_dynamic<std::string> *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+
+template phf_error_t PHF::dynamic_init<uint32_t, false>(struct phf_dynamic<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<uint64_t, false>(struct phf_dynamic<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<phf_string_t, false>(struct phf_dynamic<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+template phf_error_t PHF::dynamic_init<std::string, false>(struct phf_dynamic<std::string> *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const size_t);
+
+template phf_error_t PHF::dynamic_insert<uint32_t>(struct phf_dynamic<uint32_t> *, uint32_t, phf_hash_t *);
+template phf_error_t PHF::dynamic_insert<uint64_t>(struct phf_dynamic<uint64_t> *, uint64_t, phf_hash_t *);
+template phf_error_t PHF::dynamic_insert<phf_string_t>(struct phf_dynamic<phf_string_t> *, phf_string_t, phf_hash_t *);
+template phf_error_t PHF::dynamic_insert<std::string>(struct phf_dynamic<std::string> *, std::string, phf_hash_t *);
+
+template phf_hash_t PHF::dynamic_hash<uint32_t>(const struct phf_dynamic<uint32_t> *, uint32_t);
+template phf_hash_t PHF::dynamic_hash<uint64_t>(const struct phf_dynamic<uint64_t> *, uint64_t);
+template phf_hash_t PHF::dynamic_hash<phf_string_t>(const struct phf_dynamic<phf_string_t> *, phf_string_t);
+template phf_hash_t PHF::dynamic_hash<std::string>(const struct phf_dynamic<std::string> *, std::string);
+
+template phf_error_t PHF::dynamic_sync<uint32_t>(struct phf_dynamic<uint32_t> *, const bool);
+template phf_error_t PHF::dynamic_sync<uint64_t>(struct phf_dynamic<uint64_t> *, const bool);
+template phf_error_t PHF::dynamic_sync<phf_string_t>(struct phf_dynamic<phf_string_t> *, const bool);
+template phf_error_t PHF::dynamic_sync<std::string>(struct phf_dynamic<std::string> *, const bool);
+
+template void PHF::dynamic_destroy<uint32_t>(struct phf_dynamic<uint32_t> *);
+template void PHF::dynamic_destroy<uint64_t>(struct phf_dynamic<uint64_t> *);
+template void PHF::dynamic_destroy<phf_string_t>(struct phf_dynamic<phf_string_t> *);
+template void PHF::dynamic_destroy<std::string>(struct phf_dynamic<std::string> *);
+
+
+/*
+ * H O T  S W A P
+ *
+ * A struct phf_rcu holds an atomic pointer to the current function. A
+ * lookup is PHF::hash(PHF::rcu_load(rcu), k), where PHF::rcu_load is a
+ * single acquire load--a plain mov on x86. PHF::rcu_publish swaps in a new
+ * function and retires the old one, tagged with the epoch it was replaced
+ * at, rather than freeing it.
+ *
+ * Reclamation is quiescent-state based. Each reader thread owns a struct
+ * phf_rcu_reader and calls PHF::rcu_quiescent whenever it holds no pointer
+ * from PHF::rcu_load, e.g. between requests. That copies the global epoch
+ * into the reader's own cache line, so it costs two uncontended memory
+ * operations and is paid per batch of lookups, not per lookup. A retired
+ * function is freed once every online reader has reported an epoch at
+ * least as new as its own, since such a reader can only load its
+ * successor. Readers that block for a long time go offline so that they
+ * don't hold back reclamation.
+ *
+ * Writers serialize on a mutex, which lookups never touch.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/* free retired functions no online reader can still hold; mtx is held */
+inline size_t phf_rcu_collect(struct phf_rcu *rcu) {
+	uint64_t min = rcu->epoch.load();
+	size_t j = 0;
+
+	for (struct phf_rcu_reader *rd = rcu->readers; rd; rd = rd->next) {
+		uint64_t e = rd->epoch.load();
+
+		if (e != 0)
+			min = PHF_MIN(min, e);
+	}
+
+	for (size_t i = 0; i < rcu->retired.size(); i++) {
+		if (rcu->retired[i].second <= min) {
+			PHF::destroy(rcu->retired[i].first);
+			delete rcu->retired[i].first;
+		} else {
+			rcu->retired[j++] = rcu->retired[i];
+		}
+	}
+	rcu->retired.resize(j);
+
+	return j;
+} /* phf_rcu_collect() */
+
+phf_error_t PHF::rcu_publish(struct phf_rcu *rcu, struct phf *phf) {
+	std::lock_guard<std::mutex> lock(rcu->mtx);
+	struct phf *f, *old;
+	uint64_t e;
+
+	if (!(f = new (std::nothrow) struct phf(*phf)))
+		return ENOMEM;
+
+	/* so that retiring the old function can't fail after the swap */
+	try {
+		rcu->retired.reserve(rcu->retired.size() + 1);
+	} catch (...) {
+		delete f;
+		return ENOMEM;
+	}
+
+	phf->g = NULL; /* rcu now owns the map */
+	phf->g_huge = 0;
+
+	old = rcu->cur.exchange(f);
+	e = rcu->epoch.fetch_add(1) + 1;
+
+	if (old)
+		rcu->retired.push_back(std::make_pair(old, e));
+
+	phf_rcu_collect(rcu);
+
+	return 0;
+} /* PHF::rcu_publish() */
+
+inline const struct phf *PHF::rcu_load(const struct phf_rcu *rcu) {
+	return rcu->cur.load(std::memory_order_acquire);
+} /* PHF::rcu_load() */
+
+/*
+ * The release store orders this reader's earlier lookups before a writer
+ * that observes the new epoch frees anything. The acquire load of epoch
+ * orders any later PHF::rcu_load after the publish that bumped it.
+ */
+inline void PHF::rcu_quiescent(const struct phf_rcu *rcu, struct phf_rcu_reader *rd) {
+	rd->epoch.store(rcu->epoch.load(std::memory_order_acquire), std::memory_order_release);
+} /* PHF::rcu_quiescent() */
+
+void PHF::rcu_offline(struct phf_rcu *, struct phf_rcu_reader *rd) {
+	rd->epoch.store(0, std::memory_order_release);
+} /* PHF::rcu_offline() */
+
+/*
+ * Sequentially consistent, unlike PHF::rcu_quiescent: a writer that
+ * scanned this reader while it was offline must not have freed anything
+ * the reader's next PHF::rcu_load can return.
+ */
+void PHF::rcu_online(struct phf_rcu *rcu, struct phf_rcu_reader *rd) {
+	rd->epoch.store(rcu->epoch.load());
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+} /* PHF::rcu_online() */
+
+void PHF::rcu_register(struct phf_rcu *rcu, struct phf_rcu_reader *rd) {
+	std::lock_guard<std::mutex> lock(rcu->mtx);
+
+	rd->next = rcu->readers;
+	rcu->readers = rd;
+	PHF::rcu_online(rcu, rd);
+} /* PHF::rcu_register() */
+
+void PHF::rcu_unregister(struct phf_rcu *rcu, struct phf_rcu_reader *rd) {
+	std::lock_guard<std::mutex> lock(rcu->mtx);
+	struct phf_rcu_reader **pp;
+
+	for (pp = &rcu->readers; *pp && *pp != rd; pp = &(*pp)->next)
+		;;
+	if (*pp)
+		*pp = rd->next;
+
+	rd->next = NULL;
+	rd->epoch.store(0);
+	phf_rcu_collect(rcu);
+} /* PHF::rcu_unregister() */
+
+size_t PHF::rcu_reclaim(struct phf_rcu *rcu, const bool wait) {
+	std::unique_lock<std::mutex> lock(rcu->mtx);
+	size_t n;
+
+	while ((n = phf_rcu_collect(rcu)) > 0 && wait) {
+		lock.unlock();
+		std::this_thread::yield();
+		lock.lock();
+	}
+
+	return n;
+} /* PHF::rcu_reclaim() */
+
+void PHF::rcu_destroy(struct phf_rcu *rcu) {
+	std::lock_guard<std::mutex> lock(rcu->mtx);
+	struct phf *f;
+
+	for (size_t i = 0; i < rcu->retired.size(); i++) {
+		PHF::destroy(rcu->retired[i].first);
+		delete rcu->retired[i].first;
+	}
+	rcu->retired.clear();
+
+	if ((f = rcu->cur.exchange(NULL))) {
+		PHF::destroy(f);
+		delete f;
+	}
+} /* PHF::rcu_destroy() */
+
+
+/*
+ * S H A R E D  M E M O R Y  T A B L E S
+ *
+ * PHF::shm_create writes a function and an optional value array, such as
+ * one laid out by PHF::permute, into a memfd or a file--typically under
+ * /dev/shm, which is where shm_open(3) segments live on Linux. Other
+ * processes map it read-only with PHF::shm_attach, so every process
+ * shares the same physical pages and the table is built only once.
+ *
+ * The segment is a fixed header followed by g and the values, each
+ * aligned to a cache line. A file is written under a temporary name and
+ * renamed into place, so an attaching process never sees a partial table.
+ * A memfd is sealed against writes and resizing once it is filled, so a
+ * process that receives the descriptor can trust its contents as much as
+ * the creator's. The layout isn't portable between hosts of different
+ * byte order.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if PHF_HAVE_MMAP
+struct phf_shm_header {
+	char magic[8];
+	uint32_t g_op, nodiv, seed, d_max;
+	uint32_t pbits, reserved;
+	uint64_t r, m;
+	uint64_t g_off, g_size; /* displacement map */
+	uint64_t v_off, v_size; /* value array */
+}; /* struct phf_shm_header */
+
+static const char phf_shm_magic[8] = { 'P', 'H', 'F', 'S', 'H', 'M', '1', '\0' };
+
+#define PHF_SHM_ALIGN(n) (PHF_HOWMANY((n), 64) * 64)
+
+/* check the header of an existing mapping and point shm into it */
+inline phf_error_t phf_shm_bind(struct phf_shm *shm, void *map, size_t size) {
+	const struct phf_shm_header *hdr = static_cast<const struct phf_shm_header *>(map);
+	size_t width = 0;
+
+	if (size < sizeof *hdr || memcmp(hdr->magic, phf_shm_magic, sizeof hdr->magic))
+		return EINVAL;
+	if (hdr->g_op == PHF_G_NONE_BAND_M) {
+		if (hdr->r != 0 || hdr->m == 0 || (hdr->m & (hdr->m - 1)))
+			return EINVAL;
+	} else if (!(width = phf_gsize(hdr->g_op)) || hdr->r == 0 || hdr->m == 0) {
+		return EINVAL;
+	}
+	if (hdr->g_op >= PHF_G_UINT8_PART_R && hdr->g_op <= PHF_G_UINT32_PART_R) {
+		if (hdr->pbits > 31 || (hdr->r >> hdr->pbits) == 0)
+			return EINVAL; /* every partition needs a bucket */
+	} else if (hdr->g_op == PHF_G_UINT8_PAIR_BAND_R || hdr->g_op == PHF_G_UINT16_PAIR_BAND_R || hdr->g_op == PHF_G_UINT32_PAIR_BAND_R) {
+		if (hdr->pbits > 31 || hdr->m != (UINT64_C(1) << hdr->pbits))
+			return EINVAL; /* d0 is D >> log2(m) */
+	} else if (hdr->pbits) {
+		return EINVAL;
+	}
+	if (hdr->g_op >= PHF_G_UINT8_SKEW_R && hdr->g_op <= PHF_G_UINT32_SKEW_R && hdr->r < 2)
+		return EINVAL; /* dense and sparse buckets */
+	if (hdr->g_op >= PHF_G_UINT8_PAIR_MOD_R && hdr->g_op <= PHF_G_UINT32_PAIR_BAND_R && hdr->m < 2)
+		return EINVAL; /* f2 is reduced mod m - 1 */
+	if (hdr->g_size != hdr->r * width || hdr->g_off > size || hdr->g_size > size - hdr->g_off)
+		return EINVAL;
+	if (hdr->v_off > size || hdr->v_size > size - hdr->v_off)
+		return EINVAL;
+
+	shm->f.nodiv = hdr->nodiv != 0;
+	shm->f.seed = hdr->seed;
+	shm->f.r = static_cast<size_t>(hdr->r);
+	shm->f.m = static_cast<size_t>(hdr->m);
+	shm->f.g = reinterpret_cast<uint32_t *>(static_cast<char *>(map) + hdr->g_off);
+	shm->f.d_max = hdr->d_max;
+	shm->f.g_op = hdr->g_op;
+	shm->f.pbits = hdr->pbits;
+	shm->v = (hdr->v_size)? static_cast<char *>(map) + hdr->v_off : NULL;
+	shm->vsize = static_cast<size_t>(hdr->v_size);
+	shm->map = map;
+	shm->size = size;
+
+	return 0;
+} /* phf_shm_bind() */
+#endif
+
+phf_error_t PHF::shm_create(struct phf_shm *shm, const char *path, const struct phf *phf, const void *v, const size_t vsize) {
+#if PHF_HAVE_MMAP
+	size_t width = phf_gsize(phf->g_op);
+	struct phf_shm_header hdr;
+	std::string tmp;
+	void *map = MAP_FAILED;
+	size_t size;
+	int fd = -1, error;
+
+	if (!width && phf->g_op != PHF_G_NONE_BAND_M)
+		return EINVAL;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, phf_shm_magic, sizeof hdr.magic);
+	hdr.g_op = phf->g_op;
+	hdr.nodiv = phf->nodiv;
+	hdr.seed = phf->seed;
+	hdr.d_max = static_cast<uint32_t>(phf->d_max);
+	hdr.pbits = phf->pbits;
+	hdr.r = phf->r;
+	hdr.m = phf->m;
+	hdr.g_off = PHF_SHM_ALIGN(sizeof hdr);
+	hdr.g_size = phf->r * width;
+	hdr.v_off = PHF_SHM_ALIGN(hdr.g_off + hdr.g_size);
+	hdr.v_size = (v)? vsize : 0;
+	size = static_cast<size_t>(hdr.v_off + hdr.v_size);
+
+	if (path) {
+		tmp = std::string(path) + ".tmp." + std::to_string(static_cast<long>(getpid()));
+		if (-1 == (fd = open(tmp.c_str(), O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644)))
+			return errno;
+	} else {
+#if PHF_HAVE_MEMFD
+		if (-1 == (fd = memfd_create("phf", MFD_CLOEXEC|MFD_ALLOW_SEALING)))
+			return errno;
+#else
+		return ENOTSUP;
+#endif
+	}
+
+	if (0 != ftruncate(fd, static_cast<off_t>(size)))
+		goto syerr;
+	if (MAP_FAILED == (map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)))
+		goto syerr;
+
+	memcpy(map, &hdr, sizeof hdr);
+	if (hdr.g_size)
+		memcpy(static_cast<char *>(map) + hdr.g_off, phf->g, hdr.g_size);
+	if (hdr.v_size)
+		memcpy(static_cast<char *>(map) + hdr.v_off, v, hdr.v_size);
+
+	/* a memfd can only be sealed against writes without writable mappings */
+	munmap(map, size);
+	map = MAP_FAILED;
+
+#if PHF_HAVE_MEMFD
+	if (!path && 0 != fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE|F_SEAL_SEAL))
+		goto syerr;
+#endif
+
+	/* attach before publishing, so a failure never leaves a file at path */
+	if ((error = PHF::shm_attach_fd(shm, fd)))
+		goto error;
+
+	if (path && 0 != rename(tmp.c_str(), path)) {
+		error = errno;
+		PHF::shm_detach(shm); /* closes fd */
+		unlink(tmp.c_str());
+
+		return error;
+	}
+
+	return 0;
+syerr:
+	error = errno;
+error:
+	if (map != MAP_FAILED)
+		munmap(map, size);
+	if (!tmp.empty())
+		unlink(tmp.c_str());
+	close(fd);
+
+	return error;
+#else
+	(void)shm; (void)path; (void)phf; (void)v; (void)vsize;
+
+	return ENOTSUP;
+#endif
+} /* PHF::shm_create() */
+
+phf_error_t PHF::shm_attach(struct phf_shm *shm, const char *path) {
+#if PHF_HAVE_MMAP
+	int fd, error;
+
+	if (-1 == (fd = open(path, O_RDONLY|O_CLOEXEC)))
+		return errno;
+	if ((error = PHF::shm_attach_fd(shm, fd)))
+		close(fd);
+
+	return error;
+#else
+	(void)shm; (void)path;
+
+	return ENOTSUP;
+#endif
+} /* PHF::shm_attach() */
+
+/* takes ownership of fd on success */
+phf_error_t PHF::shm_attach_fd(struct phf_shm *shm, const int fd) {
+#if PHF_HAVE_MMAP
+	struct stat st;
+	void *map;
+	int error;
+
+	if (0 != fstat(fd, &st))
+		return errno;
+	if (st.st_size <= 0 || static_cast<uint64_t>(st.st_size) > SIZE_MAX)
+		return EINVAL;
+	if (MAP_FAILED == (map = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0)))
+		return errno;
+
+	if ((error = phf_shm_bind(shm, map, static_cast<size_t>(st.st_size)))) {
+		munmap(map, static_cast<size_t>(st.st_size));
+		return error;
+	}
+	shm->fd = fd;
+
+	return 0;
+#else
+	(void)shm; (void)fd;
+
+	return ENOTSUP;
+#endif
+} /* PHF::shm_attach_fd() */
+
+void PHF::shm_detach(struct phf_shm *shm) {
+#if PHF_HAVE_MMAP
+	if (shm->map)
+		munmap(shm->map, shm->size);
+	if (shm->fd != -1)
+		close(shm->fd);
+#endif
+	shm->map = NULL;
+	shm->size = 0;
+	shm->fd = -1;
+	shm->f.g = NULL;
+	shm->v = NULL;
+	shm->vsize = 0;
+} /* PHF::shm_detach() */
+
+
+/*
+ * P A C K E D  T A B L E S
+ *
+ * A struct phf per function, each with its own heap allocated g, costs a
+ * malloc header and a cache miss on the struct before the one on g. A
+ * pack keeps a 24-byte entry per function and concatenates the maps,
+ * each narrowed to the width its d_max needs and aligned to that width.
+ * A map of up to a cache line is placed so that it doesn't straddle one,
+ * so a lookup in a small function touches a single line of g.
+ *
+ * The image is a header, the entries and then the maps, the last two
+ * aligned to a cache line. PHF::pack_init builds it in memory exactly as
+ * PHF::pack_write stores it, and PHF::pack_open maps a stored pack
+ * read-only without copying. As with PHF::shm_create the layout isn't
+ * portable between hosts of different byte order.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+struct phf_pack_header {
+	char magic[8];
+	uint64_t n;
+	uint64_t e_off;         /* entries */
+	uint64_t g_off, g_size; /* displacement maps */
+}; /* struct phf_pack_header */
+
+static const char phf_pack_magic[8] = { 'P', 'H', 'F', 'P', 'A', 'K', '1', '\0' };
+
+#define PHF_PACK_ALIGN(n) (PHF_HOWMANY((n), 64) * 64)
+
+/* check an image and point pack into it */
+inline phf_error_t phf_pack_bind(struct phf_pack *pack, void *base, size_t size) {
+	const struct phf_pack_header *hdr = static_cast<const struct phf_pack_header *>(base);
+	const struct phf_pack_entry *e;
+
+	if (size < sizeof *hdr || memcmp(hdr->magic, phf_pack_magic, sizeof hdr->magic))
+		return EINVAL;
+	if (hdr->e_off % 64 || hdr->e_off > size || hdr->n > (size - hdr->e_off) / sizeof *e)
+		return EINVAL;
+	if (hdr->g_off % 64 || hdr->g_off > size || hdr->g_size > size - hdr->g_off)
+		return EINVAL;
+
+	e = reinterpret_cast<const struct phf_pack_entry *>(static_cast<const char *>(base) + hdr->e_off);
+
+	for (size_t i = 0; i < hdr->n; i++) {
+		size_t width = phf_gsize(e[i].g_op);
+
+		if (e[i].g_op == PHF_G_NONE_BAND_M) {
+			if (e[i].m == 0 || (e[i].m & (e[i].m - 1)))
+				return EINVAL;
+		} else if (!width || e[i].r == 0 || e[i].m == 0 || e[i].g_off % width) {
+			return EINVAL;
+		} else if (e[i].g_op >= PHF_G_UINT8_PART_R && e[i].g_op <= PHF_G_UINT32_PART_R) {
+			return EINVAL; /* needs pbits */
+		} else if (e[i].g_op == PHF_G_UINT8_PAIR_BAND_R || e[i].g_op == PHF_G_UINT16_PAIR_BAND_R || e[i].g_op == PHF_G_UINT32_PAIR_BAND_R) {
+			return EINVAL; /* needs pbits */
+		} else if (e[i].g_op >= PHF_G_UINT8_SKEW_R && e[i].g_op <= PHF_G_UINT32_SKEW_R && e[i].r < 2) {
+			return EINVAL;
+		} else if (e[i].g_op >= PHF_G_UINT8_PAIR_MOD_R && e[i].m < 2) {
+			return EINVAL;
+		} else if (e[i].g_off > hdr->g_size || static_cast<uint64_t>(e[i].r) * width > hdr->g_size - e[i].g_off) {
+			return EINVAL;
+		}
+	}
+
+	pack->n = static_cast<size_t>(hdr->n);
+	pack->e = e;
+	pack->g = static_cast<const char *>(base) + hdr->g_off;
+	pack->base = base;
+	pack->size = size;
+
+	return 0;
+} /* phf_pack_bind() */
+
+phf_error_t PHF::pack_init(struct phf_pack *pack, const struct phf f[], const size_t n) {
+	struct phf_pack_header hdr;
+	struct phf_pack_entry *e;
+	std::vector<uint64_t> off;
+	uint64_t size = 0;
+	void *mem;
+	char *base, *g;
+
+	try {
+		off.resize(n);
+	} catch (std::bad_alloc &) {
+		return ENOMEM;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		size_t width = phf_batch_width(&f[i]);
+		uint64_t z = f[i].r * width;
+
+		if (!width && f[i].g_op != PHF_G_NONE_BAND_M)
+			return EINVAL;
+		if (phf_layout(&f[i]) == PHF_LAYOUT_PART)
+			return EINVAL; /* meant for large tables, entries have no pbits */
+		if (phf_layout(&f[i]) == PHF_LAYOUT_PAIR && f[i].nodiv)
+			return EINVAL; /* entries have no pbits for d0 */
+		if (width && !phf_gsize(f[i].g_op))
+			return EINVAL;
+		if (f[i].r > UINT32_MAX || f[i].m > UINT32_MAX)
+			return ERANGE;
+		if (!width)
+			continue;
+
+		size = PHF_HOWMANY(size, width) * width;
+		if (z <= 64 && size % 64 + z > 64)
+			size = PHF_PACK_ALIGN(size); /* don't straddle a cache line */
+		off[i] = size;
+		size += z;
+	}
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, phf_pack_magic, sizeof hdr.magic);
+	hdr.n = n;
+	hdr.e_off = PHF_PACK_ALIGN(sizeof hdr);
+	hdr.g_off = PHF_PACK_ALIGN(hdr.e_off + n * sizeof *e);
+	hdr.g_size = size;
+	size += hdr.g_off;
+
+	if (size > SIZE_MAX - 63)
+		return ENOMEM;
+	if (!(mem = calloc(1, static_cast<size_t>(size) + 63)))
+		return errno;
+	base = reinterpret_cast<char *>(PHF_PACK_ALIGN(reinterpret_cast<uintptr_t>(mem)));
+	e = reinterpret_cast<struct phf_pack_entry *>(base + hdr.e_off);
+	g = base + hdr.g_off;
+
+	memcpy(base, &hdr, sizeof hdr);
+
+	for (size_t i = 0; i < n; i++) {
+		size_t width = phf_batch_width(&f[i]), from = phf_gsize(f[i].g_op);
+
+		e[i].g_off = off[i];
+		e[i].seed = f[i].seed;
+		e[i].r = static_cast<uint32_t>(f[i].r);
+		e[i].m = static_cast<uint32_t>(f[i].m);
+
+		e[i].g_op = phf_gresize(f[i].g_op, width);
+		if (!width)
+			continue;
+
+		for (size_t j = 0; j < f[i].r; j++) {
+			uint32_t d = (from == sizeof (uint8_t))? reinterpret_cast<const uint8_t *>(f[i].g)[j]
+			           : (from == sizeof (uint16_t))? reinterpret_cast<const uint16_t *>(f[i].g)[j]
+			           : f[i].g[j];
+
+			if (width == sizeof (uint8_t))
+				reinterpret_cast<uint8_t *>(g + off[i])[j] = static_cast<uint8_t>(d);
+			else if (width == sizeof (uint16_t))
+				reinterpret_cast<uint16_t *>(g + off[i])[j] = static_cast<uint16_t>(d);
+			else
+				reinterpret_cast<uint32_t *>(g + off[i])[j] = d;
+		}
+	}
+
+	(void)phf_pack_bind(pack, base, static_cast<size_t>(size));
+	pack->mem = mem;
+	pack->mapped = false;
+
+	return 0;
+} /* PHF::pack_init() */
+
+template<typename key_t>
+phf_hash_t PHF::pack_hash(const struct phf_pack *pack, const size_t id, key_t k) {
+	const struct phf_pack_entry *e = &pack->e[id];
+
+	return phf_hash_op(e->g_op, pack->g + e->g_off, k, e->seed, e->r, e->m, 0);
+} /* PHF::pack_hash() */
+
+template phf_hash_t PHF::pack_hash<uint32_t>(const struct phf_pack *, const size_t, uint32_t);
+template phf_hash_t PHF::pack_hash<uint64_t>(const struct phf_pack *, const size_t, uint64_t);
+template phf_hash_t PHF::pack_hash<phf_string_t>(const struct phf_pack *, const size_t, phf_string_t);
+template phf_hash_t PHF::pack_hash<std::string>(const struct phf_pack *, const size_t, std::string);
+
+/* store size bytes at base in path, atomically by a rename */
+inline phf_error_t phf_image_write(const void *base, size_t size, const char *path) {
+#if PHF_HAVE_MMAP
+	std::string tmp = std::string(path) + ".tmp." + std::to_string(static_cast<long>(getpid()));
+	const char *p = static_cast<const char *>(base);
+	size_t left = size;
+	int fd, error;
+
+	if (-1 == (fd = open(tmp.c_str(), O_WRONLY|O_CREAT|O_EXCL|O_CLOEXEC, 0644)))
+		return errno;
+
+	while (left > 0) {
+		ssize_t count = write(fd, p, left);
+
+		if (count == -1) {
+			if (errno == EINTR)
+				continue;
+			goto syerr;
+		}
+		p += count;
+		left -= static_cast<size_t>(count);
+	}
+
+	if (0 != close(fd)) {
+		fd = -1;
+		goto syerr;
+	}
+	fd = -1;
+	if (0 != rename(tmp.c_str(), path))
+		goto syerr;
+
+	return 0;
+syerr:
+	error = errno;
+	if (fd != -1)
+		close(fd);
+	unlink(tmp.c_str());
+
+	return error;
+#else
+	(void)base; (void)size; (void)path;
+
+	return ENOTSUP;
+#endif
+} /* phf_image_write() */
+
+/* map path read-only; release with munmap(2) */
+inline phf_error_t phf_image_map(const char *path, void **base, size_t *size) {
+#if PHF_HAVE_MMAP
+	struct stat st;
+	void *map;
+	int fd, error;
+
+	if (-1 == (fd = open(path, O_RDONLY|O_CLOEXEC)))
+		return errno;
+	if (0 != fstat(fd, &st)) {
+		error = errno;
+		close(fd);
+		return error;
+	}
+	if (st.st_size <= 0 || static_cast<uint64_t>(st.st_size) > SIZE_MAX) {
+		close(fd);
+		return EINVAL;
+	}
+	map = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	error = errno;
+	close(fd); /* the mapping keeps the file */
+	if (map == MAP_FAILED)
+		return error;
+
+	*base = map;
+	*size = static_cast<size_t>(st.st_size);
+
+	return 0;
+#else
+	(void)path; (void)base; (void)size;
+
+	return ENOTSUP;
+#endif
+} /* phf_image_map() */
+
+phf_error_t PHF::pack_write(const struct phf_pack *pack, const char *path) {
+	return phf_image_write(pack->base, pack->size, path);
+} /* PHF::pack_write() */
+
+phf_error_t PHF::pack_open(struct phf_pack *pack, const char *path) {
+	void *map = NULL;
+	size_t size = 0;
+	int error;
+
+	if ((error = phf_image_map(path, &map, &size)))
+		return error;
+
+	if ((error = phf_pack_bind(pack, map, size))) {
+#if PHF_HAVE_MMAP
+		munmap(map, size);
+#endif
+		return error;
+	}
+	pack->mem = NULL;
+	pack->mapped = true;
+
+	return 0;
+} /* PHF::pack_open() */
+
+void PHF::pack_destroy(struct phf_pack *pack) {
+#if PHF_HAVE_MMAP
+	if (pack->mapped)
+		munmap(pack->base, pack->size);
+#endif
+	free(pack->mem);
+	pack->n = 0;
+	pack->e = NULL;
+	pack->g = NULL;
+	pack->base = NULL;
+	pack->size = 0;
+	pack->mem = NULL;
+	pack->mapped = false;
+} /* PHF::pack_destroy() */
+
+
+/*
+ * E N C O D E D  M A P S
+ *
+ * PHF::compact can only pick a byte width for the whole map, while most
+ * displacements are far smaller than d_max. PHF::encode re-encodes the
+ * map of a finished function in one of four ways:
+ *
+ *   PHF_ENC_COMPACT  every value in bits(d_max) bits
+ *   PHF_ENC_PART     blocks of 256 values, each in the bits its own
+ *                    maximum needs, found through a word per block
+ *   PHF_ENC_INTER    per 64 values, the rank of the block's first
+ *                    exception, a bitmap of exceptions and the low b bits
+ *                    of every value, interleaved in one run of words. The
+ *                    high bits of the few exceptions, the values of 2^b
+ *                    or more, are in a second table, indexed by rank
+ *   PHF_ENC_DICT     the distinct values, most frequent first, and a code
+ *                    into them per value, in two tiers laid out as with
+ *                    PHF_ENC_INTER: the 2^b most frequent values get b-bit
+ *                    codes, and the rest are exceptions whose full
+ *                    bits(distinct - 1)-bit codes are in the second table
+ *
+ * Each has a decoder with an operator[], so PHF::enc_hash runs the same
+ * phf_hash_* template as PHF::hash, only reading g through the decoder.
+ * With PHF_ENC_AUTO, PHF::encode takes the fastest of them, in the order
+ * above, that fits in max_size bytes, or the smallest if none does or
+ * max_size is 0.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define PHF_ENC_BLOCK 256 /* values per PHF_ENC_PART block */
+
+struct phf_dec_compact {
+	const uint64_t *w;
+	unsigned width;
+
+	uint32_t operator[](size_t i) const {
+		return static_cast<uint32_t>(phf_getbits(w, i, width));
+	}
+}; /* struct phf_dec_compact */
+
+struct phf_dec_part {
+	const uint64_t *w, *hdr;
+
+	uint32_t operator[](size_t i) const {
+		uint64_t h = hdr[i / PHF_ENC_BLOCK];
+
+		return static_cast<uint32_t>(phf_getbits(w + (h >> 8), i % PHF_ENC_BLOCK, h & 255));
+	}
+}; /* struct phf_dec_part */
+
+struct phf_dec_inter {
+	const uint64_t *w, *hi;
+	unsigned width, hwidth;
+
+	uint32_t operator[](size_t i) const {
+		const uint64_t *b = w + (i / 64) * (2 + width);
+		unsigned j = i % 64;
+		uint64_t d = phf_getbits(b + 2, j, width);
+
+		if ((b[1] >> j) & 1)
+			d |= phf_getbits(hi, b[0] + phf_popcount(b[1] & ((UINT64_C(1) << j) - 1)), hwidth) << width;
+
+		return static_cast<uint32_t>(d);
+	}
+}; /* struct phf_dec_inter */
+
+struct phf_dec_dict {
+	const uint64_t *w, *hi;
+	const uint32_t *dict;
+	unsigned width, hwidth;
+
+	uint32_t operator[](size_t i) const {
+		const uint64_t *b = w + (i / 64) * (2 + width);
+		unsigned j = i % 64;
+
+		if ((b[1] >> j) & 1)
+			return dict[phf_getbits(hi, b[0] + phf_popcount(b[1] & ((UINT64_C(1) << j) - 1)), hwidth)];
+
+		return dict[phf_getbits(b + 2, j, width)];
+	}
+}; /* struct phf_dec_dict */
+
+/* bits needed for x, at least 1 */
+inline unsigned phf_enc_bits(uint64_t x) {
+	unsigned n = 1;
+
+	while (n < 64 && (x >> n))
+		n++;
+
+	return n;
+} /* phf_enc_bits() */
+
+/* words of a PHF_ENC_INTER map with b low bits; exc[k] counts values of k bits */
+inline size_t phf_enc_inter_words(size_t r, const size_t exc[33], unsigned bits, unsigned b) {
+	size_t n = 0;
+
+	for (unsigned k = b + 1; k <= bits; k++)
+		n += exc[k];
+
+	return PHF_HOWMANY(r, 64) * (2 + b) + 1 + ((n)? PHF_HOWMANY(n * (bits - b), 64) + 1 : 0);
+} /* phf_enc_inter_words() */
+
+/* words of a PHF_ENC_DICT map with b-bit short codes and n exceptions of bits each */
+inline size_t phf_enc_dict_words(size_t r, size_t n, unsigned bits, unsigned b) {
+	return PHF_HOWMANY(r, 64) * (2 + b) + 1 + ((n)? PHF_HOWMANY(n * bits, 64) + 1 : 0);
+} /* phf_enc_dict_words() */
+
+phf_error_t PHF::encode(struct phf_enc *enc, const struct phf *f, const uint32_t kind, const size_t max_size) {
+	static const uint32_t order[] = { PHF_ENC_COMPACT, PHF_ENC_PART, PHF_ENC_INTER, PHF_ENC_DICT };
+	const size_t width = phf_gsize(f->g_op), r = (width)? f->r : 0;
+	std::vector<uint32_t> d, dict;
+	std::vector<size_t> count; /* occurrences of each dict value */
+	std::vector<std::pair<uint32_t, uint32_t> > code; /* value, code */
+	size_t exc[33] = { 0 }, size[PHF_ENC_INTER + 1] = { 0 };
+	uint32_t d_max = 0, use = kind;
+	unsigned bits, ib = 1, db = 1, dbits = 1;
+	struct phf_enc e;
+
+	if (kind > PHF_ENC_INTER || (!width && f->g_op != PHF_G_NONE_BAND_M))
+		return EINVAL;
+
+	try {
+		d.resize(r);
+		for (size_t i = 0; i < r; i++) {
+			d[i] = (width == sizeof (uint8_t))? reinterpret_cast<const uint8_t *>(f->g)[i]
+			     : (width == sizeof (uint16_t))? reinterpret_cast<const uint16_t *>(f->g)[i]
+			     : f->g[i];
+			d_max = PHF_MAX(d_max, d[i]);
+			exc[phf_enc_bits(d[i])]++;
+		}
+		bits = phf_enc_bits(d_max);
+
+		/* distinct values by falling frequency */
+		if (kind == PHF_ENC_AUTO || kind == PHF_ENC_DICT) {
+			std::vector<uint32_t> tmp(d);
+			std::vector<std::pair<size_t, uint32_t> > freq; /* -count, value */
+
+			std::sort(tmp.begin(), tmp.end());
+			for (size_t i = 0, j; i < tmp.size(); i = j) {
+				for (j = i + 1; j < tmp.size() && tmp[j] == tmp[i]; j++)
+					;
+				freq.push_back(std::make_pair(SIZE_MAX - (j - i), tmp[i]));
+			}
+			std::sort(freq.begin(), freq.end());
+
+			for (size_t i = 0; i < freq.size(); i++) {
+				dict.push_back(freq[i].second);
+				count.push_back(SIZE_MAX - freq[i].first);
+				code.push_back(std::make_pair(freq[i].second, static_cast<uint32_t>(i)));
+			}
+			std::sort(code.begin(), code.end());
+		}
+	} catch (std::bad_alloc &) {
+		return ENOMEM;
+	}
+
+	/* sizes, to pick a kind and the low bits of PHF_ENC_INTER */
+	size[PHF_ENC_COMPACT] = (PHF_HOWMANY(r * bits, 64) + 1) * 8;
+
+	size[PHF_ENC_PART] = 1;
+	for (size_t i = 0; i < r; i += PHF_ENC_BLOCK) {
+		size_t z = PHF_MIN(r - i, (size_t)PHF_ENC_BLOCK);
+
+		size[PHF_ENC_PART] += 1 + PHF_HOWMANY(z * phf_enc_bits(*std::max_element(&d[i], &d[i] + z)), 64);
+	}
+	size[PHF_ENC_PART] *= 8;
+
+	for (unsigned b = 2; b <= bits; b++) {
+		if (phf_enc_inter_words(r, exc, bits, b) < phf_enc_inter_words(r, exc, bits, ib))
+			ib = b;
+	}
+	size[PHF_ENC_INTER] = phf_enc_inter_words(r, exc, bits, ib) * 8;
+
+	/* short codes of db bits for the 2^db most frequent values */
+	if (!dict.empty()) {
+		size_t best = SIZE_MAX, top = 0;
+
+		dbits = phf_enc_bits(dict.size() - 1);
+		for (unsigned b = 1; b <= dbits; b++) {
+			size_t words;
+
+			for (size_t i = (b > 1)? (size_t)1 << (b - 1) : 0; i < PHF_MIN((size_t)1 << b, dict.size()); i++)
+				top += count[i];
+			if ((words = phf_enc_dict_words(r, r - top, dbits, b)) < best) {
+				best = words;
+				db = b;
+			}
+		}
+		size[PHF_ENC_DICT] = dict.size() * sizeof dict[0] + best * 8;
+	}
+
+	if (use == PHF_ENC_AUTO) {
+		use = PHF_ENC_COMPACT;
+		for (size_t i = 0; i < PHF_COUNTOF(order); i++) {
+			if (size[order[i]] < size[use])
+				use = order[i];
+		}
+		for (size_t i = 0; max_size && i < PHF_COUNTOF(order); i++) {
+			if (size[order[i]] <= max_size) {
+				use = order[i];
+				break;
+			}
+		}
+	}
+
+	e.kind = use;
+	e.f = *f;
+	e.f.g = NULL;
+	e.f.g_huge = 0;
+	e.f.alloc = NULL;
+	e.f.g_op = phf_gresize(f->g_op, sizeof (uint32_t));
+
+	if (!r) {
+		*enc = e; /* no map */
+		return 0;
+	}
+
+	switch (use) {
+	case PHF_ENC_COMPACT:
+		e.width = bits;
+		if (!(e.w = static_cast<uint64_t *>(calloc(PHF_HOWMANY(r * bits, 64) + 1, sizeof *e.w))))
+			goto syerr;
+		for (size_t i = 0; i < r; i++)
+			phf_setbits(e.w, i, bits, d[i]);
+		break;
+	case PHF_ENC_PART: {
+		size_t nb = PHF_HOWMANY(r, PHF_ENC_BLOCK), off = 0;
+
+		if (!(e.hdr = static_cast<uint64_t *>(calloc(nb, sizeof *e.hdr))))
+			goto syerr;
+		for (size_t b = 0; b < nb; b++) {
+			size_t i = b * PHF_ENC_BLOCK, z = PHF_MIN(r - i, (size_t)PHF_ENC_BLOCK);
+			unsigned bw = phf_enc_bits(*std::max_element(&d[i], &d[i] + z));
+
+			e.hdr[b] = (static_cast<uint64_t>(off) << 8) | bw;
+			off += PHF_HOWMANY(z * bw, 64);
+		}
+		if (!(e.w = static_cast<uint64_t *>(calloc(off + 1, sizeof *e.w))))
+			goto syerr;
+		for (size_t i = 0; i < r; i++) {
+			uint64_t h = e.hdr[i / PHF_ENC_BLOCK];
+
+			phf_setbits(e.w + (h >> 8), i % PHF_ENC_BLOCK, h & 255, d[i]);
+		}
+		break;
+	}
+	case PHF_ENC_INTER: {
+		size_t nb = PHF_HOWMANY(r, 64), n = 0;
+
+		for (unsigned k = ib + 1; k <= bits; k++)
+			n += exc[k];
+
+		e.width = ib;
+		e.hwidth = bits - ib;
+		if (!(e.w = static_cast<uint64_t *>(calloc(nb * (2 + ib) + 1, sizeof *e.w))))
+			goto syerr;
+		if (n && !(e.hi = static_cast<uint64_t *>(calloc(PHF_HOWMANY(n * e.hwidth, 64) + 1, sizeof *e.hi))))
+			goto syerr;
+
+		n = 0;
+		for (size_t i = 0; i < r; i++) {
+			uint64_t *b = e.w + (i / 64) * (2 + ib);
+
+			if (i % 64 == 0)
+				b[0] = n;
+			phf_setbits(b + 2, i % 64, ib, d[i] & ((UINT64_C(1) << ib) - 1));
+			if (d[i] >> ib) {
+				b[1] |= UINT64_C(1) << (i % 64);
+				phf_setbits(e.hi, n++, e.hwidth, d[i] >> ib);
+			}
+		}
+		break;
+	}
+	case PHF_ENC_DICT: {
+		size_t nb = PHF_HOWMANY(r, 64), n = 0;
+
+		for (size_t i = (size_t)1 << db; i < count.size(); i++)
+			n += count[i];
+
+		e.width = db;
+		e.hwidth = dbits;
+		if (!(e.dict = static_cast<uint32_t *>(malloc(dict.size() * sizeof *e.dict))))
+			goto syerr;
+		memcpy(e.dict, dict.data(), dict.size() * sizeof *e.dict);
+		if (!(e.w = static_cast<uint64_t *>(calloc(nb * (2 + db) + 1, sizeof *e.w))))
+			goto syerr;
+		if (n && !(e.hi = static_cast<uint64_t *>(calloc(PHF_HOWMANY(n * dbits, 64) + 1, sizeof *e.hi))))
+			goto syerr;
+
+		n = 0;
+		for (size_t i = 0; i < r; i++) {
+			uint64_t *b = e.w + (i / 64) * (2 + db);
+			uint32_t c = std::lower_bound(code.begin(), code.end(), std::make_pair(d[i], (uint32_t)0))->second;
+
+			if (i % 64 == 0)
+				b[0] = n;
+			if (c >> db) {
+				b[1] |= UINT64_C(1) << (i % 64);
+				phf_setbits(e.hi, n++, dbits, c);
+			} else {
+				phf_setbits(b + 2, i % 64, db, c);
+			}
+		}
+		break;
+	}
+	}
+
+	e.size = size[use];
+	*enc = e;
+
+	return 0;
+syerr:
+	PHF::enc_destroy(&e);
+
+	return ENOMEM;
+} /* PHF::encode() */
+
+template<typename key_t>
+phf_hash_t PHF::enc_hash(const struct phf_enc *enc, key_t k) {
+	const struct phf *f = &enc->f;
+
+	switch (enc->kind) {
+	case PHF_ENC_PART: {
+		struct phf_dec_part g = { enc->w, enc->hdr };
+
+		return phf_hash_dec(f->g_op, g, k, f->seed, f->r, f->m, f->pbits);
+	}
+	case PHF_ENC_INTER: {
+		struct phf_dec_inter g = { enc->w, enc->hi, enc->width, enc->hwidth };
+
+		return phf_hash_dec(f->g_op, g, k, f->seed, f->r, f->m, f->pbits);
+	}
+	case PHF_ENC_DICT: {
+		struct phf_dec_dict g = { enc->w, enc->hi, enc->dict, enc->width, enc->hwidth };
+
+		return phf_hash_dec(f->g_op, g, k, f->seed, f->r, f->m, f->pbits);
+	}
+	default: {
+		struct phf_dec_compact g = { enc->w, enc->width };
+
+		return phf_hash_dec(f->g_op, g, k, f->seed, f->r, f->m, f->pbits);
+	}
+	}
+} /* PHF::enc_hash() */
+
+template phf_hash_t PHF::enc_hash<uint32_t>(const struct phf_enc *, uint32_t);
+template phf_hash_t PHF::enc_hash<uint64_t>(const struct phf_enc *, uint64_t);
+template phf_hash_t PHF::enc_hash<phf_string_t>(const struct phf_enc *, phf_string_t);
+template phf_hash_t PHF::enc_hash<std::string>(const struct phf_enc *, std::string);
+
+void PHF::enc_destroy(struct phf_enc *enc) {
+	free(enc->w);
+	free(enc->hdr);
+	free(enc->hi);
+	free(enc->dict);
+	enc->w = NULL;
+	enc->hdr = NULL;
+	enc->hi = NULL;
+	enc->dict = NULL;
+	enc->size = 0;
+} /* PHF::enc_destroy() */
+
+
+/*
+ * R E C U R S I V E  S P L I T T I N G
+ *
+ * PHF::split_init builds a RecSplit function, for when space matters more
+ * than build time. Keys are hashed to 64 bits and spread over buckets of
+ * about `bucket` keys. Each bucket is split recursively: a node of m keys
+ * searches for the first seed x under which mix(h + x) divides its keys
+ * into parts of the prescribed sizes, and a leaf of at most `leaf` keys
+ * for the first x that maps them one to one onto [0, m). Nodes of more
+ * than `upper` keys are halved, in multiples of upper, nodes of more than
+ * `lower` keys are split into parts of lower keys and smaller ones into
+ * leaves.
+ *
+ * The seeds of a bucket are Golomb-Rice coded in preorder, all fixed parts
+ * first and then all unary parts. The parameter of a node depends only on
+ * its size, and so do the number of codes and of fixed bits in a subtree,
+ * so a lookup passes over a sibling subtree without decoding it: a known
+ * number of bits in the fixed parts and of set bits in the unary ones.
+ * Two Elias-Fano sequences locate a bucket: the keys before it and the
+ * position of its codes.
+ *
+ * Buckets are independent, so each thread builds a contiguous run of them
+ * into its own stream, and the streams are concatenated.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+struct phf_split_header {
+	char magic[8];
+	uint64_t n, nb, seed, leaf, smax;
+	uint64_t nbits;          /* of codes in w */
+	uint64_t off[8], len[8]; /* memo, keys lo hi sel, bits lo hi sel, w */
+}; /* struct phf_split_header */
+
+static const char phf_split_magic[8] = { 'P', 'H', 'F', 'S', 'P', 'L', '1', '\0' };
+
+#define PHF_SPLIT_LEAF_MAX 16 /* a leaf of m keys takes about e^m seeds to map one to one */
+#define PHF_EF_SAMPLE 64 /* elements per phf_ef::sel entry */
+
+/* words of lo, hi and sel of an Elias-Fano sequence of n elements up to u */
+inline unsigned phf_ef_size(size_t n, uint64_t u, size_t len[3]) {
+	unsigned l = 0;
+
+	while (l < 56 && (u >> (l + 1)) >= n)
+		l++;
+
+	len[0] = PHF_HOWMANY(n * l, 64) + 1;
+	len[1] = PHF_HOWMANY(n + (u >> l) + 1, 64) + 1;
+	len[2] = PHF_MAX(PHF_HOWMANY(n, PHF_EF_SAMPLE), 1);
+
+	return l;
+} /* phf_ef_size() */
+
+inline void phf_ef_fill(uint64_t *lo, uint64_t *hi, uint64_t *sel, unsigned l, const std::vector<uint64_t> &v) {
+	for (size_t i = 0; i < v.size(); i++) {
+		uint64_t pos = (v[i] >> l) + i;
+
+		if (l)
+			phf_setbits(lo, i, l, v[i] & ((UINT64_C(1) << l) - 1));
+		hi[pos / 64] |= UINT64_C(1) << (pos % 64);
+		if (i % PHF_EF_SAMPLE == 0)
+			sel[i / PHF_EF_SAMPLE] = pos;
+	}
+} /* phf_ef_fill() */
+
+/* position in hi of element i */
+inline size_t phf_ef_pos(const struct phf_ef *ef, size_t i) {
+	size_t p = ef->sel[i / PHF_EF_SAMPLE], w = p / 64;
+	uint64_t x = ef->hi[w] & (~UINT64_C(0) << (p % 64));
+	unsigned k = i % PHF_EF_SAMPLE, c;
+
+	while ((c = phf_popcount(x)) <= k) {
+		k -= c;
+		x = ef->hi[++w];
+	}
+
+	return w * 64 + phf_select(x, k);
+} /* phf_ef_pos() */
+
+inline uint64_t phf_ef_get(const struct phf_ef *ef, size_t i) {
+	return (static_cast<uint64_t>(phf_ef_pos(ef, i) - i) << ef->l) | phf_getbits(ef->lo, i, ef->l);
+} /* phf_ef_get() */
+
+/* elements i and i + 1 */
+inline void phf_ef_get2(const struct phf_ef *ef, size_t i, uint64_t *v0, uint64_t *v1) {
+	size_t p = phf_ef_pos(ef, i), q = phf_skipbits(ef->hi, p + 1, 1) - 1;
+
+	*v0 = (static_cast<uint64_t>(p - i) << ef->l) | phf_getbits(ef->lo, i, ef->l);
+	*v1 = (static_cast<uint64_t>(q - i - 1) << ef->l) | phf_getbits(ef->lo, i + 1, ef->l);
+} /* phf_ef_get2() */
+
+/* 64-bit hash of a key, from the same f() as PHF::pair_init */
+template<typename T>
+inline uint64_t phf_split_h(T k, uint32_t seed) {
+	return (static_cast<uint64_t>(phf_f(0, k, seed)) << 32) | phf_f(1, k, seed);
+} /* phf_split_h() */
+
+/* MurmurHash3's 64-bit finalizer of h + x, salted by the depth of the node */
+inline uint64_t phf_split_mix(uint64_t h, uint64_t x, unsigned depth) {
+	h += x + (static_cast<uint64_t>(depth) << 56);
+	h ^= h >> 33;
+	h *= UINT64_C(0xff51afd7ed558ccd);
+	h ^= h >> 33;
+	h *= UINT64_C(0xc4ceb9fe1a85ec53);
+	h ^= h >> 33;
+
+	return h;
+} /* phf_split_mix() */
+
+/* h scaled into [0, m) by its high bits */
+inline size_t phf_split_remap(uint64_t h, size_t m) {
+	return static_cast<size_t>(((h >> 32) * m) >> 32);
+} /* phf_split_remap() */
+
+/* size of each part but the last of a node of m > leaf keys */
+inline size_t phf_split_unit(const struct phf_split *s, size_t m) {
+	if (m > s->upper)
+		return PHF_HOWMANY(m / 2, s->upper) * s->upper;
+	else if (m > s->lower)
+		return s->lower;
+	else
+		return s->leaf;
+} /* phf_split_unit() */
+
+/* RecSplit's aggregation sizes for leaf */
+inline void phf_split_aggr(struct phf_split *s, size_t leaf) {
+	s->leaf = leaf;
+	s->lower = leaf * PHF_MAX(2, (35 * leaf + 149) / 100);     /* ceil(0.35 leaf + 0.5) leaves */
+	s->upper = s->lower * ((leaf < 7)? 2 : (21 * leaf + 189) / 100); /* ceil(0.21 leaf + 0.9) lower nodes */
+} /* phf_split_aggr() */
+
+/*
+ * Rice parameter for a seed found with probability exp(lp) per try. The
+ * seed is geometric, so with parameter k a code takes k + 1/(1 - (1-q)^2^k)
+ * bits on average; take the k that minimizes it.
+ */
+inline uint32_t phf_split_golomb(double lp) {
+	double l1q = std::log1p(-std::exp(lp)), best = HUGE_VAL;
+	uint32_t k = 0;
+
+	for (uint32_t i = 0; i <= 56; i++) {
+		double bits = i + 1 / -std::expm1(std::ldexp(l1q, i));
+
+		if (bits < best) {
+			best = bits;
+			k = i;
+		}
+	}
+
+	return k;
+} /* phf_split_golomb() */
+
+/* fixed bits and codes of the subtree of a node of m > 1 keys, given rice */
+inline void phf_split_count(const struct phf_split *s, size_t m, const uint32_t *rice, uint64_t *fixed, uint64_t *nodes) {
+	size_t unit, k, last;
+
+	if (m <= s->leaf) {
+		*fixed = rice[m];
+		*nodes = 1;
+		return;
+	}
+
+	unit = phf_split_unit(s, m);
+	k = PHF_HOWMANY(m, unit);
+	last = m - (k - 1) * unit;
+	*fixed = rice[m] + (k - 1) * static_cast<uint64_t>(s->fixed[unit]) + s->fixed[last];
+	*nodes = 1 + (k - 1) * static_cast<uint64_t>(s->nodes[unit]) + s->nodes[last];
+} /* phf_split_count() */
+
+/* memo of the node parameters, smax + 1 each of rice, fixed and nodes */
+inline void phf_split_memo(struct phf_split *s, size_t smax, uint32_t *memo) {
+	uint32_t *rice = memo, *fixed = memo + smax + 1, *nodes = memo + 2 * (smax + 1);
+
+	s->rice = rice;
+	s->fixed = fixed;
+	s->nodes = nodes;
+
+	for (size_t m = 0; m <= smax; m++) {
+		uint64_t f = 0, c = 0;
+
+		if (m <= 1) {
+			rice[m] = 0;
+		} else if (m <= s->leaf) {
+			rice[m] = phf_split_golomb(std::lgamma(m + 1.0) - m * std::log(static_cast<double>(m)));
+		} else {
+			size_t unit = phf_split_unit(s, m), k = PHF_HOWMANY(m, unit), last = m - (k - 1) * unit;
+			double lp = std::lgamma(m + 1.0) - (k - 1) * std::lgamma(unit + 1.0) - std::lgamma(last + 1.0)
+			          + (k - 1) * unit * std::log(static_cast<double>(unit) / m) + last * std::log(static_cast<double>(last) / m);
+
+			rice[m] = phf_split_golomb(lp);
+		}
+		if (m > 1)
+			phf_split_count(s, m, rice, &f, &c);
+		fixed[m] = static_cast<uint32_t>(f);
+		nodes[m] = static_cast<uint32_t>(c);
+	}
+} /* phf_split_memo() */
+
+/* search the seeds of the subtree of h[0, m), appending them in preorder with their parameter */
+inline void phf_split_node(const struct phf_split *s, uint64_t *h, uint64_t *tmp, size_t m, unsigned depth, std::vector<std::pair<uint64_t, unsigned> > &code) {
+	size_t count[16], unit, k, last;
+	uint64_t x;
+
+	if (m <= 1)
+		return;
+
+	if (m <= s->leaf) {
+		const uint32_t full = (UINT32_C(1) << m) - 1;
+
+		for (x = 0;; x++) {
+			uint32_t mask = 0;
+
+			for (size_t i = 0; i < m; i++)
+				mask |= UINT32_C(1) << phf_split_remap(phf_split_mix(h[i], x, depth), m);
+			if (mask == full)
+				break;
+		}
+		code.push_back(std::make_pair(x, s->rice[m]));
+
+		return;
+	}
+
+	unit = phf_split_unit(s, m);
+	k = PHF_HOWMANY(m, unit);
+	last = m - (k - 1) * unit;
+
+	/* no part may exceed unit, so with the last one right all are */
+	for (x = 0;; x++) {
+		size_t i;
+
+		std::fill(count, count + k, 0);
+		for (i = 0; i < m; i++) {
+			if (++count[phf_split_remap(phf_split_mix(h[i], x, depth), m) / unit] > unit)
+				break;
+		}
+		if (i == m && count[k - 1] == last)
+			break;
+	}
+	code.push_back(std::make_pair(x, s->rice[m]));
+
+	for (size_t c = 0; c < k; c++)
+		count[c] = c * unit;
+	for (size_t i = 0; i < m; i++)
+		tmp[count[phf_split_remap(phf_split_mix(h[i], x, depth), m) / unit]++] = h[i];
+	memcpy(h, tmp, m * sizeof *h);
+
+	for (size_t c = 0; c < k; c++)
+		phf_split_node(s, h + c * unit, tmp, (c == k - 1)? last : unit, depth + 1, code);
+} /* phf_split_node() */
+
+/* append width bits of v to a growing stream */
+inline void phf_split_put(std::vector<uint64_t> &w, size_t *pos, uint64_t v, unsigned width) {
+	if (w.size() < (*pos + width) / 64 + 2)
+		w.resize(PHF_MAX(2 * w.size(), (*pos + width) / 64 + 2), 0);
+	if (width)
+		phf_writebits(w.data(), *pos, width, v);
+	*pos += width;
+} /* phf_split_put() */
+
+/* set bits among n from bit pos */
+inline size_t phf_countbits(const uint64_t *w, size_t pos, size_t n) {
+	size_t c = 0;
+
+	for (size_t i = 0; i < n; i += 32)
+		c += phf_popcount(phf_readbits(w, pos + i, static_cast<unsigned>(PHF_MIN(n - i, (size_t)32))));
+
+	return c;
+} /* phf_countbits() */
+
+/* check an image and point split into it */
+inline phf_error_t phf_split_bind(struct phf_split *split, void *base, size_t size) {
+	const struct phf_split_header *hdr = static_cast<const struct phf_split_header *>(base);
+	const char *p = static_cast<const char *>(base);
+	struct phf_split s;
+	size_t need[8], ef[3];
+	uint64_t k0 = 0, b0 = 0;
+
+	if (size < sizeof *hdr || memcmp(hdr->magic, phf_split_magic, sizeof hdr->magic))
+		return EINVAL;
+	if (hdr->leaf < 2 || hdr->leaf > PHF_SPLIT_LEAF_MAX || hdr->n > PHF_HASH_MAX)
+		return EINVAL;
+	if (hdr->nb < 1 || hdr->nb > PHF_MAX(hdr->n, 1) || hdr->smax > hdr->n || hdr->nbits > (uint64_t)SIZE_MAX / 2)
+		return EINVAL;
+
+	need[0] = 3 * (static_cast<size_t>(hdr->smax) + 1) * sizeof (uint32_t);
+	s.keys.l = phf_ef_size(static_cast<size_t>(hdr->nb) + 1, hdr->n, ef);
+	for (int i = 0; i < 3; i++)
+		need[1 + i] = ef[i] * sizeof (uint64_t);
+	s.bits.l = phf_ef_size(static_cast<size_t>(hdr->nb) + 1, hdr->nbits, ef);
+	for (int i = 0; i < 3; i++)
+		need[4 + i] = ef[i] * sizeof (uint64_t);
+	need[7] = (PHF_HOWMANY(static_cast<size_t>(hdr->nbits), 64) + 1) * sizeof (uint64_t);
+
+	for (int i = 0; i < 8; i++) {
+		if (hdr->off[i] % 8 || hdr->off[i] > size || hdr->len[i] > size - hdr->off[i] || hdr->len[i] < need[i])
+			return EINVAL;
+	}
+
+	s.n = static_cast<size_t>(hdr->n);
+	s.nb = static_cast<size_t>(hdr->nb);
+	s.seed = static_cast<phf_seed_t>(hdr->seed);
+	s.smax = static_cast<size_t>(hdr->smax);
+	phf_split_aggr(&s, static_cast<size_t>(hdr->leaf));
+	s.rice = reinterpret_cast<const uint32_t *>(p + hdr->off[0]);
+	s.fixed = s.rice + s.smax + 1;
+	s.nodes = s.rice + 2 * (s.smax + 1);
+	s.keys.lo = reinterpret_cast<const uint64_t *>(p + hdr->off[1]);
+	s.keys.hi = reinterpret_cast<const uint64_t *>(p + hdr->off[2]);
+	s.keys.sel = reinterpret_cast<const uint64_t *>(p + hdr->off[3]);
+	s.bits.lo = reinterpret_cast<const uint64_t *>(p + hdr->off[4]);
+	s.bits.hi = reinterpret_cast<const uint64_t *>(p + hdr->off[5]);
+	s.bits.sel = reinterpret_cast<const uint64_t *>(p + hdr->off[6]);
+	s.w = reinterpret_cast<const uint64_t *>(p + hdr->off[7]);
+
+	/* the memo must describe the tree shape, so lookups skip consistently */
+	for (size_t m = 0; m <= s.smax; m++) {
+		uint64_t f = 0, c = 0;
+
+		if (s.rice[m] > 56)
+			return EINVAL;
+		if (m > 1)
+			phf_split_count(&s, m, s.rice, &f, &c);
+		if (s.fixed[m] != f || s.nodes[m] != c)
+			return EINVAL;
+	}
+
+	/* each sequence needs exactly its elements in hi, and true samples */
+	for (int e = 0; e < 2; e++) {
+		const struct phf_ef *ef = (e)? &s.bits : &s.keys;
+		size_t words = need[2 + 3 * e] / sizeof (uint64_t), ones = 0, pos = 0;
+
+		for (size_t i = 0; i < words; i++)
+			ones += phf_popcount(ef->hi[i]);
+		if (ones != s.nb + 1)
+			return EINVAL;
+		for (size_t i = 0; i <= s.nb; i++) {
+			pos = phf_skipbits(ef->hi, pos, 1);
+			if (i % PHF_EF_SAMPLE == 0 && ef->sel[i / PHF_EF_SAMPLE] != pos - 1)
+				return EINVAL;
+		}
+	}
+
+	/* buckets must be in order, and hold the fixed bits and unary codes of their tree */
+	if (phf_ef_get(&s.keys, 0) != 0 || phf_ef_get(&s.bits, 0) != 0)
+		return EINVAL;
+	for (size_t b = 0; b < s.nb; b++) {
+		uint64_t k1 = phf_ef_get(&s.keys, b + 1), b1 = phf_ef_get(&s.bits, b + 1);
+
+		if (k1 < k0 || k1 - k0 > s.smax || b1 < b0 || b1 > hdr->nbits)
+			return EINVAL;
+		if (b1 - b0 < s.fixed[k1 - k0])
+			return EINVAL;
+		if (phf_countbits(s.w, static_cast<size_t>(b0 + s.fixed[k1 - k0]), static_cast<size_t>(b1 - b0 - s.fixed[k1 - k0])) != s.nodes[k1 - k0])
+			return EINVAL;
+		k0 = k1;
+		b0 = b1;
+	}
+	if (k0 != s.n || b0 != hdr->nbits)
+		return EINVAL;
+
+	s.base = base;
+	s.size = size;
+	*split = s;
+
+	return 0;
+} /* phf_split_bind() */
+
+template<typename key_t>
+phf_error_t PHF::split_init(struct phf_split *split, const key_t k[], const size_t n, const size_t leaf, const size_t bucket, const phf_seed_t seed, const unsigned threads) {
+	const unsigned nthreads = PHF_MAX(threads, 1);
+	const size_t nb = PHF_MAX(PHF_HOWMANY(n, PHF_MAX(bucket, 1)), 1);
+	struct phf_split s;
+	struct phf_split_header hdr;
+	std::vector<uint64_t> h, hb, kpos, bpos;
+	std::vector<size_t> start;
+	std::vector<uint32_t> memo;
+	std::vector<std::vector<uint64_t> > out;
+	std::vector<size_t> olen, blen;
+	std::vector<int> error;
+	std::atomic<bool> dup(true);
+	phf_seed_t sd = seed;
+	size_t smax = 0, size, ef[3];
+	uint64_t nbits = 0;
+	void *mem;
+	char *base;
+	int rv;
+
+	if (leaf < 2 || leaf > PHF_SPLIT_LEAF_MAX || bucket < 1)
+		return EINVAL;
+	if (n > PHF_HASH_MAX)
+		return ERANGE;
+	phf_split_aggr(&s, leaf);
+
+	try {
+		out.resize(nthreads);
+		olen.resize(nthreads, 0);
+		error.resize(nthreads, 0);
+		h.resize(n);
+		hb.resize(n);
+		start.resize(nb + 1);
+
+		/* a 64-bit collision is as fatal as a duplicate; try a few seeds */
+		for (unsigned attempt = 0; attempt < 4 && dup.load(); attempt++) {
+			sd = seed + attempt;
+
+			phf_prun(nthreads, [&](unsigned t) {
+				for (size_t i = n * t / nthreads; i < n * (t + 1) / nthreads; i++)
+					h[i] = phf_split_h(k[i], sd);
+			});
+
+			std::fill(start.begin(), start.end(), 0);
+			for (size_t i = 0; i < n; i++)
+				start[phf_split_remap(h[i], nb) + 1]++;
+			for (size_t b = 0; b < nb; b++)
+				start[b + 1] += start[b];
+			kpos.assign(start.begin(), start.end() - 1);
+			for (size_t i = 0; i < n; i++)
+				hb[kpos[phf_split_remap(h[i], nb)]++] = h[i];
+
+			dup = false;
+			phf_prun(nthreads, [&](unsigned t) {
+				for (size_t b = nb * t / nthreads; b < nb * (t + 1) / nthreads; b++) {
+					std::sort(hb.data() + start[b], hb.data() + start[b + 1]);
+					if (std::adjacent_find(hb.data() + start[b], hb.data() + start[b + 1]) != hb.data() + start[b + 1])
+						dup = true;
+				}
+			});
+		}
+		if (dup)
+			return EEXIST;
+		std::vector<uint64_t>().swap(h);
+
+		for (size_t b = 0; b < nb; b++)
+			smax = PHF_MAX(smax, start[b + 1] - start[b]);
+		memo.resize(3 * (smax + 1));
+		phf_split_memo(&s, smax, memo.data());
+		blen.resize(nb);
+	} catch (std::bad_alloc &) {
+		return ENOMEM;
+	}
+
+	phf_prun(nthreads, [&](unsigned t) {
+		try {
+			std::vector<std::pair<uint64_t, unsigned> > code;
+			std::vector<uint64_t> tmp(PHF_MAX(smax, 1));
+			size_t pos = 0;
+
+			for (size_t b = nb * t / nthreads; b < nb * (t + 1) / nthreads; b++) {
+				size_t from = pos;
+
+				code.clear();
+				phf_split_node(&s, hb.data() + start[b], tmp.data(), start[b + 1] - start[b], 0, code);
+
+				for (size_t i = 0; i < code.size(); i++)
+					phf_split_put(out[t], &pos, code[i].first & ((UINT64_C(1) << code[i].second) - 1), code[i].second);
+				for (size_t i = 0; i < code.size(); i++) {
+					pos += static_cast<size_t>(code[i].first >> code[i].second);
+					phf_split_put(out[t], &pos, 1, 1);
+				}
+				blen[b] = pos - from;
+			}
+			olen[t] = pos;
+		} catch (std::bad_alloc &) {
+			error[t] = ENOMEM;
+		}
+	});
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		if (error[t])
+			return error[t];
+		nbits += olen[t];
+	}
+
+	/* lay out the image: header, memo, the two sequences, then the codes */
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, phf_split_magic, sizeof hdr.magic);
+	hdr.n = n;
+	hdr.nb = nb;
+	hdr.seed = sd;
+	hdr.leaf = leaf;
+	hdr.smax = smax;
+	hdr.nbits = nbits;
+	hdr.len[0] = memo.size() * sizeof memo[0];
+	phf_ef_size(nb + 1, n, ef);
+	for (int i = 0; i < 3; i++)
+		hdr.len[1 + i] = ef[i] * sizeof (uint64_t);
+	phf_ef_size(nb + 1, nbits, ef);
+	for (int i = 0; i < 3; i++)
+		hdr.len[4 + i] = ef[i] * sizeof (uint64_t);
+	hdr.len[7] = (PHF_HOWMANY(nbits, 64) + 1) * sizeof (uint64_t);
+	hdr.off[0] = PHF_PACK_ALIGN(sizeof hdr);
+	for (int i = 1; i < 8; i++)
+		hdr.off[i] = PHF_PACK_ALIGN(hdr.off[i - 1] + hdr.len[i - 1]);
+	size = static_cast<size_t>(hdr.off[7] + hdr.len[7]);
+
+	if (!(mem = calloc(1, size + 63)))
+		return errno;
+	base = reinterpret_cast<char *>(PHF_PACK_ALIGN(reinterpret_cast<uintptr_t>(mem)));
+	memcpy(base, &hdr, sizeof hdr);
+	memcpy(base + hdr.off[0], memo.data(), hdr.len[0]);
+
+	try {
+		kpos.resize(nb + 1);
+		bpos.resize(nb + 1);
+		for (size_t b = 0; b <= nb; b++) {
+			kpos[b] = start[b];
+			bpos[b] = (b)? bpos[b - 1] + blen[b - 1] : 0;
+		}
+	} catch (std::bad_alloc &) {
+		free(mem);
+		return ENOMEM;
+	}
+	phf_ef_fill(reinterpret_cast<uint64_t *>(base + hdr.off[1]), reinterpret_cast<uint64_t *>(base + hdr.off[2]), reinterpret_cast<uint64_t *>(base + hdr.off[3]), phf_ef_size(nb + 1, n, ef), kpos);
+	phf_ef_fill(reinterpret_cast<uint64_t *>(base + hdr.off[4]), reinterpret_cast<uint64_t *>(base + hdr.off[5]), reinterpret_cast<uint64_t *>(base + hdr.off[6]), phf_ef_size(nb + 1, nbits, ef), bpos);
+
+	/* concatenate the streams, 32 bits at a time as they needn't be word aligned */
+	for (size_t t = 0, pos = 0; t < nthreads; pos += olen[t], t++) {
+		uint64_t *w = reinterpret_cast<uint64_t *>(base + hdr.off[7]);
+
+		for (size_t i = 0; i < olen[t]; i += 32) {
+			unsigned z = static_cast<unsigned>(PHF_MIN(olen[t] - i, (size_t)32));
+
+			phf_writebits(w, pos + i, z, phf_readbits(out[t].data(), i, z));
+		}
+	}
+
+	if ((rv = phf_split_bind(split, base, size))) {
+		free(mem);
+		return rv;
+	}
+	split->mem = mem;
+	split->mapped = false;
+
+	return 0;
+} /* PHF::split_init() */
+
+template<typename key_t>
+phf_hash_t PHF::split_hash(const struct phf_split *split, key_t k) {
+	uint64_t h = phf_split_h(k, split->seed), k0, k1, x;
+	size_t b = phf_split_remap(h, split->nb), m, fpos, upos, e;
+	unsigned depth = 0;
+
+	phf_ef_get2(&split->keys, b, &k0, &k1);
+	m = static_cast<size_t>(k1 - k0);
+	fpos = static_cast<size_t>(phf_ef_get(&split->bits, b));
+	upos = fpos + split->fixed[m];
+
+	while (m > 1) {
+		unsigned p = split->rice[m];
+		size_t r, unit, c;
+
+		x = phf_readbits(split->w, fpos, p);
+		fpos += p;
+		e = phf_skipbits(split->w, upos, 1);
+		x |= static_cast<uint64_t>(e - upos - 1) << p;
+		upos = e;
+
+		r = phf_split_remap(phf_split_mix(h, x, depth), m);
+		if (m <= split->leaf)
+			return static_cast<phf_hash_t>(k0 + r);
+
+		/* pass over the subtrees of the parts before ours */
+		unit = phf_split_unit(split, m);
+		c = r / unit;
+		fpos += c * split->fixed[unit];
+		upos = phf_skipbits(split->w, upos, c * split->nodes[unit]);
+
+		k0 += c * unit;
+		m = (c == PHF_HOWMANY(m, unit) - 1)? m - c * unit : unit;
+		depth++;
+	}
+
+	return static_cast<phf_hash_t>(k0);
+} /* PHF::split_hash() */
+
+template phf_error_t PHF::split_init<uint32_t>(struct phf_split *, const uint32_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+template phf_error_t PHF::split_init<uint64_t>(struct phf_split *, const uint64_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+template phf_error_t PHF::split_init<phf_string_t>(struct phf_split *, const phf_string_t[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+template phf_error_t PHF::split_init<std::string>(struct phf_split *, const std::string[], const size_t, const size_t, const size_t, const phf_seed_t, const unsigned);
+
+template phf_hash_t PHF::split_hash<uint32_t>(const struct phf_split *, uint32_t);
+template phf_hash_t PHF::split_hash<uint64_t>(const struct phf_split *, uint64_t);
+template phf_hash_t PHF::split_hash<phf_string_t>(const struct phf_split *, phf_string_t);
+template phf_hash_t PHF::split_hash<std::string>(const struct phf_split *, std::string);
+
+phf_error_t PHF::split_write(const struct phf_split *split, const char *path) {
+	return phf_image_write(split->base, split->size, path);
+} /* PHF::split_write() */
+
+phf_error_t PHF::split_open(struct phf_split *split, const char *path) {
+	void *map = NULL;
+	size_t size = 0;
+	int error;
+
+	if ((error = phf_image_map(path, &map, &size)))
+		return error;
+
+	if ((error = phf_split_bind(split, map, size))) {
+#if PHF_HAVE_MMAP
+		munmap(map, size);
+#endif
+		return error;
+	}
+	split->mem = NULL;
+	split->mapped = true;
+
+	return 0;
+} /* PHF::split_open() */
+
+void PHF::split_destroy(struct phf_split *split) {
+#if PHF_HAVE_MMAP
+	if (split->mapped)
+		munmap(split->base, split->size);
+#endif
+	free(split->mem);
+	*split = phf_split();
+} /* PHF::split_destroy() */
+
+
+/*
+ * V A L U E  P E R M U T A T I O N
+ *
+ * PHF::permute stores values[i] at out[hash(k[i])]. Scattering directly
+ * costs a cache miss, and for large tables a TLB miss, per value. Instead
+ * all hashes are computed first, streaming through the keys. Then
+ * (hash, value) pairs are radix partitioned by the high bits of the hash,
+ * where a partition is a run of output slots small enough to stay in L2
+ * cache, and finally each partition is written out. Every pass reads
+ * sequentially and writes either to one of a few hundred streams or within
+ * a cache-resident window. Partitions are disjoint, so they can be written
+ * by different threads.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef PHF_PERMUTE_BLOCK
+#define PHF_PERMUTE_BLOCK (256 * 1024) /* bytes of output per partition */
+#endif
+
+template<typename key_t, typename value_t>
+phf_error_t PHF::permute(const struct phf *phf, const key_t k[], const value_t v[], const size_t n, value_t out[], const unsigned threads) {
+	const unsigned nthreads = PHF_MAX(threads, 1);
+	size_t pshift = 0, P;
+	struct pair { uint32_t h; value_t v; } *part = NULL;
+	uint32_t *h = NULL;
+	std::vector<size_t> count, cursor;
+	std::atomic<size_t> next(0);
+
+	/* slots per partition, as a power of 2 */
+	while (((size_t)2 << pshift) * sizeof *out <= PHF_PERMUTE_BLOCK)
+		pshift++;
+	P = PHF_HOWMANY(phf->m, (size_t)1 << pshift);
+
+	if (P <= 1 || n < 4096) {
+		for (size_t i = 0; i < n; i++)
+			out[PHF::hash(phf, k[i])] = v[i];
+		return 0;
+	}
+
+	if (!(h = static_cast<uint32_t *>(malloc(n * sizeof *h))))
+		return errno;
+	if (phf_calloc(&part, n)) {
+		free(h);
+		return ENOMEM;
+	}
+
+	/* allocated here, as a throw in a worker would terminate */
+	try {
+		count.assign(P * nthreads + 1, 0);
+		cursor.resize(P * nthreads);
+	} catch (std::bad_alloc &) {
+		phf_freearray(part, n);
+		free(h);
+		return ENOMEM;
+	}
+
+	/* hash and count in one streaming pass */
+	phf_prun(nthreads, [&](unsigned t) {
+		size_t *z = &count[t * P];
+
+		for (size_t i = n * t / nthreads; i < n * (t + 1) / nthreads; i++) {
+			h[i] = PHF::hash(phf, k[i]);
+			z[h[i] >> pshift]++;
+		}
+	});
+
+	/* partition-major, thread-minor offsets keep each partition in input order */
+	for (size_t p = 0, o = 0; p < P; p++) {
+		for (unsigned t = 0; t < nthreads; t++) {
+			size_t z = count[t * P + p];
+			count[t * P + p] = o;
+			o += z;
+		}
+	}
+	std::copy(count.begin(), count.end() - 1, cursor.begin());
+
+	phf_prun(nthreads, [&](unsigned t) {
+		size_t *z = &cursor[t * P];
+
+		for (size_t i = n * t / nthreads; i < n * (t + 1) / nthreads; i++) {
+			struct pair *p = &part[z[h[i] >> pshift]++];
+
+			p->h = h[i];
+			p->v = v[i];
+		}
+	});
+
+	/* count[p] is now where partition p starts; the end is the next start */
+	count[P] = n;
+
+	phf_prun(nthreads, [&](unsigned) {
+		size_t p;
+
+		while ((p = next++) < P) {
+			for (size_t j = count[p]; j < count[p + 1]; j++)
+				out[part[j].h] = part[j].v;
+		}
+	});
+
+	phf_freearray(part, n);
+	free(h);
+
+	return 0;
+} /* PHF::permute() */
+
+
+/*
+ * M O N O T O N E  M I N I M A L  P E R F E C T  H A S H I N G
+ *
+ * For a sorted key set PHF::mono_hash returns the rank of each key, so the
+ * function doubles as a rank index. Keys are split by rank into buckets of
+ * 2^bshift consecutive keys. The first key of each bucket is kept as a
+ * separator, found by binary search, and an ordinary CHD function over all
+ * keys indexes a packed table of bshift-bit ranks within the bucket:
+ *
+ *   mono_hash(k) = (bucket(k) << bshift) + rank[hash(k)]
+ *
+ * Space is roughly bshift * m/n + (key bits)/2^bshift + CHD bits per key,
+ * e.g. about 10 bits for 64-bit keys with bshift 5, a = 99 and modular
+ * division, against 64 for a stored rank map. With nodiv m may be up to
+ * twice n, which inflates the rank table accordingly.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+template<typename key_t, bool nodiv>
+phf_error_t PHF::mono_init(struct phf_mono<key_t> *mono, const key_t k[], const size_t n, const size_t l, const size_t a, const unsigned bshift, const phf_seed_t seed) {
+	struct phf f;
+	key_t *sep = NULL;
+	uint64_t *rank = NULL;
+	size_t nb;
+	int error;
+
+	if (bshift < 1 || bshift > 16)
+		return EINVAL;
+
+	nb = PHF_HOWMANY(n, (size_t)1 << bshift);
+
+	/* must be sorted and unique, e.g. the output of PHF::uniq */
+	for (size_t i = 1; i < n; i++) {
+		if (!(k[i - 1] < k[i]))
+			return EINVAL;
+	}
+
+	if ((error = PHF::init<key_t, nodiv>(&f, k, n, l, a, seed)))
+		return error;
+	PHF::compact(&f);
+
+	if ((error = phf_calloc(&sep, PHF_MAX(nb, 1))))
+		goto error;
+	/* one spare word so phf_getbits can always read a word ahead */
+	if (!(rank = static_cast<uint64_t *>(calloc(PHF_HOWMANY(f.m * bshift, 64) + 1, sizeof *rank))))
+		goto syerr;
+
+	for (size_t i = 0; i < n; i++) {
+		if (!(i & (((size_t)1 << bshift) - 1)))
+			sep[i >> bshift] = k[i];
+		phf_setbits(rank, PHF::hash(&f, k[i]), bshift, i & (((size_t)1 << bshift) - 1));
+	}
+
+	mono->f = f;
+	mono->n = n;
+	mono->nb = nb;
+	mono->bshift = bshift;
+	mono->sep = sep;
+	mono->rank = rank;
+
+	return 0;
+syerr:
+	error = errno;
+error:
+	free(rank);
+	if (sep)
+		phf_freearray(sep, PHF_MAX(nb, 1));
+	PHF::destroy(&f);
+
+	return error;
+} /* PHF::mono_init() */
+
+template<typename key_t>
+phf_hash_t PHF::mono_hash(const struct phf_mono<key_t> *mono, key_t k) {
+	size_t b;
+
+	if (mono->nb == 0)
+		return 0;
+
+	/* last bucket whose first key is <= k */
+	b = std::upper_bound(mono->sep, mono->sep + mono->nb, k) - mono->sep;
+	b -= (b > 0);
+
+	return static_cast<phf_hash_t>((b << mono->bshift) + phf_getbits(mono->rank, PHF::hash(&mono->f, k), mono->bshift));
+} /* PHF::mono_hash() */
+
+template<typename key_t>
+void PHF::mono_destroy(struct phf_mono<key_t> *mono) {
+	PHF::destroy(&mono->f);
+	if (mono->sep)
+		phf_freearray(mono->sep, PHF_MAX(mono->nb, 1));
+	mono->sep = NULL;
+	free(mono->rank);
+	mono->rank = NULL;
+	mono->n = 0;
+	mono->nb = 0;
+	mono->bshift = 0;
+} /* PHF::mono_destroy() */
+
+template phf_error_t PHF::mono_init<uint32_t, true>(struct phf_mono<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<uint64_t, true>(struct phf_mono<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<phf_string_t, true>(struct phf_mono<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<std::string, true>(struct phf_mono<std::string> *, const std::string[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+
+template phf_error_t PHF::mono_init<uint32_t, false>(struct phf_mono<uint32_t> *, const uint32_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<uint64_t, false>(struct phf_mono<uint64_t> *, const uint64_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<phf_string_t, false>(struct phf_mono<phf_string_t> *, const phf_string_t[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+template phf_error_t PHF::mono_init<std::string, false>(struct phf_mono<std::string> *, const std::string[], const size_t, const size_t, const size_t, const unsigned, const phf_seed_t);
+
+template phf_hash_t PHF::mono_hash<uint32_t>(const struct phf_mono<uint32_t> *, uint32_t);
+template phf_hash_t PHF::mono_hash<uint64_t>(const struct phf_mono<uint64_t> *, uint64_t);
+template phf_hash_t PHF::mono_hash<phf_string_t>(const struct phf_mono<phf_string_t> *, phf_string_t);
+template phf_hash_t PHF::mono_hash<std::string>(const struct phf_mono<std::string> *, std::string);
+
+template void PHF::mono_destroy<uint32_t>(struct phf_mono<uint32_t> *);
+template void PHF::mono_destroy<uint64_t>(struct phf_mono<uint64_t> *);
+template void PHF::mono_destroy<phf_string_t>(struct phf_mono<phf_string_t> *);
+template void PHF::mono_destroy<std::string>(struct phf_mono<std::string> *);
+
+
+/*
+ * S O U R C E  G E N E R A T O R
+ *
+ * PHF::generate writes a self-contained C++ source file for a generated
+ * function, like gperf(1). The displacement map is emitted as a static
+ * array of the width PHF::compact selected, and the lookup routine is
+ * specialized for the key type, the modular reduction mode, and constant
+ * r and m, so the emitted file doesn't depend on phf.h.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+namespace PHF {
+	namespace Gen {
+		static const char hashsrc[] =
+			"static inline uint32_t round32(uint32_t k1, uint32_t h1) {\n"
+			"\tk1 *= UINT32_C(0xcc9e2d51);\n"
+			"\tk1 = (k1 << 15) | (k1 >> 17);\n"
+			"\tk1 *= UINT32_C(0x1b873593);\n"
+			"\th1 ^= k1;\n"
+			"\th1 = (h1 << 13) | (h1 >> 19);\n"
+			"\treturn h1 * 5 + UINT32_C(0xe6546b64);\n"
+			"}\n"
+			"\n"
+			"static inline uint32_t round32(const unsigned char *p, size_t n, uint32_t h1) {\n"
+			"\tuint32_t k1 = 0;\n"
+			"\tfor (; n >= 4; p += 4, n -= 4)\n"
+			"\t\th1 = round32(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3], h1);\n"
+			"\tswitch (n) {\n"
+			"\tcase 3: k1 |= (uint32_t)p[2] << 8; /* FALLTHROUGH */\n"
+			"\tcase 2: k1 |= (uint32_t)p[1] << 16; /* FALLTHROUGH */\n"
+			"\tcase 1: k1 |= (uint32_t)p[0] << 24; h1 = round32(k1, h1);\n"
+			"\t}\n"
+			"\treturn h1;\n"
+			"}\n"
+			"\n"
+			"static inline uint32_t mix32(uint32_t h1) {\n"
+			"\th1 ^= h1 >> 16;\n"
+			"\th1 *= UINT32_C(0x85ebca6b);\n"
+			"\th1 ^= h1 >> 13;\n"
+			"\th1 *= UINT32_C(0xc2b2ae35);\n"
+			"\th1 ^= h1 >> 16;\n"
+			"\treturn h1;\n"
+			"}\n";
+
+		/* key type specifics: parameter list, hash rounds, key literals */
+		template<typename T> struct key_traits;
+
+		template<> struct key_traits<uint32_t> {
+			static const char *ctype() { return "uint32_t"; }
+			static const char *params() { return "uint32_t k"; }
+			static const char *args() { return "k"; }
+			static const char *rounds() { return "round32(k, h1)"; }
+			static void literal(std::ostream &os, uint32_t k) { os << "UINT32_C(" << k << ")"; }
+			static const char *equal() { return "keys[h] == k"; }
+		}; /* key_traits<uint32_t> */
+
+		template<> struct key_traits<uint64_t> {
+			static const char *ctype() { return "uint64_t"; }
+			static const char *params() { return "uint64_t k"; }
+			static const char *args() { return "k"; }
+			static const char *rounds() { return "round32((uint32_t)(k >> 32), round32((uint32_t)k, h1))"; }
+			static void literal(std::ostream &os, uint64_t k) { os << "UINT64_C(" << k << ")"; }
+			static const char *equal() { return "keys[h] == k"; }
+		}; /* key_traits<uint64_t> */
+
+		struct string_traits {
+			static const char *ctype() { return "struct { const char *p; size_t n; }"; }
+			static const char *params() { return "const void *p, size_t n"; }
+			static const char *args() { return "p, n"; }
+			static const char *rounds() { return "round32((const unsigned char *)p, n, h1)"; }
+			static const char *equal() { return "keys[h].n == n && 0 == memcmp(keys[h].p, p, n)"; }
+
+			static void literal(std::ostream &os, const unsigned char *p, size_t n) {
+				static const char hex[] = "0123456789abcdef";
+
+				os << "{ \"";
+				for (size_t i = 0; i < n; i++) {
+					if (p[i] == '"' || p[i] == '\\') {
+						os << '\\' << p[i];
+					} else if (p[i] >= 0x20 && p[i] < 0x7f && p[i] != '?') {
+						os << p[i];
+					} else {
+						/* split the literal so a following hex digit isn't absorbed */
+						os << "\\x" << hex[p[i] >> 4] << hex[p[i] & 15] << "\" \"";
+					}
+				}
+				os << "\", " << n << " }";
+			} /* literal() */
+		}; /* struct string_traits */
+
+		template<> struct key_traits<phf_string_t> : string_traits {
+			static void literal(std::ostream &os, const phf_string_t &k) { string_traits::literal(os, static_cast<const unsigned char *>(k.p), k.n); }
+		}; /* key_traits<phf_string_t> */
+
+		template<> struct key_traits<std::string> : string_traits {
+			static void literal(std::ostream &os, const std::string &k) { string_traits::literal(os, reinterpret_cast<const unsigned char *>(k.data()), k.size()); }
+		}; /* key_traits<std::string> */
+
+		template<typename map_t>
+		static void gtable(std::ostream &os, const char *type, const void *g, size_t r) {
+			const map_t *p = static_cast<const map_t *>(g);
+
+			os << "static const " << type << " g[" << PHF_MAX(r, 1) << "] = {";
+			for (size_t i = 0; i < r; i++)
+				os << ((i % 16)? " " : "\n\t") << static_cast<uint32_t>(p[i]) << ",";
+			os << "\n};\n\n";
+		} /* gtable() */
+	} /* Gen:: */
+} /* PHF:: */
+
+template<typename key_t>
+phf_error_t PHF::generate(std::ostream &os, const struct phf *phf, const char *name, const key_t k[], const size_t n, const char *const v[], const char *vtype) {
+	typedef PHF::Gen::key_traits<key_t> traits;
+	const char *mod = (phf->nodiv)? " & (" : " % ";
+	const char *end = (phf->nodiv)? " - 1)" : "";
+	void (*gtable)(std::ostream &, const char *, const void *, size_t) = NULL;
+	const char *gtype = NULL;
+
+	/* reject unsupported layouts before anything is written */
+	switch (phf->g_op) {
+	case PHF_G_UINT8_MOD_R:
+	case PHF_G_UINT8_BAND_R:
+		gtable = &PHF::Gen::gtable<uint8_t>;
+		gtype = "uint8_t";
+		break;
+	case PHF_G_UINT16_MOD_R:
+	case PHF_G_UINT16_BAND_R:
+		gtable = &PHF::Gen::gtable<uint16_t>;
+		gtype = "uint16_t";
+		break;
+	case PHF_G_UINT32_MOD_R:
+	case PHF_G_UINT32_BAND_R:
+		gtable = &PHF::Gen::gtable<uint32_t>;
+		gtype = "uint32_t";
+		break;
+	case PHF_G_NONE_BAND_M:
+		break;
+	default:
+		return EINVAL;
+	}
+
+	os << "/* " << name << " - generated by PHF::generate. Do not edit. */\n"
+	   << "#include <stddef.h>\n#include <stdint.h>\n#include <string.h>\n";
+	if (std::is_same<key_t, std::string>::value)
+		os << "#include <string>\n";
+	os << "\nnamespace " << name << "_phf {\n\n"
+	   << "static const uint32_t seed = UINT32_C(" << phf->seed << ");\n"
+	   << "static const size_t r = " << phf->r << ";\n"
+	   << "static const size_t m = " << phf->m << ";\n\n";
+
+	if (gtable)
+		gtable(os, gtype, phf->g, phf->r);
+
+	os << PHF::Gen::hashsrc << "\n} /* " << name << "_phf */\n\n"
+	   << "static inline uint32_t " << name << "(" << traits::params() << ") {\n"
+	   << "\tusing namespace " << name << "_phf;\n";
+	if (phf->g_op == PHF_G_NONE_BAND_M) {
+		os << "\tuint32_t h1 = seed;\n\n"
+		   << "\th1 = mix32(" << traits::rounds() << ");\n\n"
+		   << "\treturn h1 & (m - 1);\n";
+	} else {
+		os << "\tuint32_t h1 = seed, d;\n\n"
+		   << "\th1 = mix32(" << traits::rounds() << ");\n"
+		   << "\td = g[h1" << mod << "r" << end << "];\n\n"
+		   << "\th1 = round32(d, seed);\n"
+		   << "\th1 = mix32(" << traits::rounds() << ");\n\n"
+		   << "\treturn h1" << mod << "m" << end << ";\n";
+	}
+	os << "} /* " << name << "() */\n";
+
+	if (std::is_same<key_t, std::string>::value) {
+		os << "\nstatic inline uint32_t " << name << "(const std::string &k) {\n"
+		   << "\treturn " << name << "(k.data(), k.size());\n"
+		   << "}\n";
+	}
+
+	if (k) {
+		std::vector<size_t> slot(phf->m, SIZE_MAX);
+
+		for (size_t i = 0; i < n; i++)
+			slot[PHF::hash(phf, k[i])] = i;
+
+		os << "\n/* keys in hash order; used[h] is nonzero if slot h holds a key */\n"
+		   << "static const unsigned char " << name << "_used[" << phf->m << "] = {";
+		for (size_t h = 0; h < phf->m; h++)
+			os << ((h % 32)? " " : "\n\t") << (slot[h] != SIZE_MAX) << ",";
+		os << "\n};\n\n";
+
+		os << "static const " << traits::ctype() << " " << name << "_keys[" << phf->m << "] = {\n";
+		for (size_t h = 0; h < phf->m; h++) {
+			os << "\t";
+			if (slot[h] != SIZE_MAX)
+				traits::literal(os, k[slot[h]]);
+			else
+				os << "{}";
+			os << ",\n";
+		}
+		os << "};\n";
+
+		if (v) {
+			os << "\nstatic " << ((vtype)? vtype : "const char *") << " " << name << "_values[" << phf->m << "] = {\n";
+			for (size_t h = 0; h < phf->m; h++)
+				os << "\t" << ((slot[h] != SIZE_MAX)? v[slot[h]] : "{}") << ",\n";
+			os << "};\n";
+		}
+
+		os << "\nstatic inline bool " << name << "_contains(" << traits::params() << ") {\n"
+		   << "\tconst auto &keys = " << name << "_keys;\n"
+		   << "\tuint32_t h = " << name << "(" << traits::args() << ");\n\n"
+		   << "\treturn " << name << "_used[h] && " << traits::equal() << ";\n"
+		   << "} /* " << name << "_contains() */\n";
+	}
+
+	return (os.good())? 0 : EIO;
+} /* PHF::generate() */
+
+template phf_error_t PHF::generate<uint32_t>(std::ostream &, const struct phf *, const char *, const uint32_t[], const size_t, const char *const[], const char *);
+template phf_error_t PHF::generate<uint64_t>(std::ostream &, const struct phf *, const char *, const uint64_t[], const size_t, const char *const[], const char *);
+template phf_error_t PHF::generate<phf_string_t>(std::ostream &, const struct phf *, const char *, const phf_string_t[], const size_t, const char *const[], const char *);
+template phf_error_t PHF::generate<std::string>(std::ostream &, const struct phf *, const char *, const std::string[], const size_t, const char *const[], const char *);
+
+
+/*
+ * C O M P I L E - T I M E  T A B L E S
+ *
+ * PHF::cx::make_table runs the same construction as PHF::init inside a
+ * constant expression, for key sets known at compile time:
+ *
+ *   constexpr std::string_view kw[] = { "if", "else", "while", ... };
+ *   constexpr auto kwhash = PHF::cx::make_table<true>(kw);
+ *
+ *   switch (kwhash(word)) { ... }
+ *
+ * Buckets are ordered by decreasing size and then decreasing g(k) % r, and
+ * displacements are searched from 1 exactly as in PHF::init, so for the
+ * same keys, parameters and seed the table is identical to the one
+ * PHF::init would build for std::string keys--unless PHF::init maps the
+ * set without a displacement map (see phf_tiny), which a table whose m
+ * is a template constant can't follow. That only happens for sets of up
+ * to PHF_TINY_MAX keys, and never with PHF_TINY_MAX 0. The ordering is
+ * done with two counting sorts to stay well within compiler evaluation
+ * limits.
+ *
+ * r and m are template constants, so lookups reduce with a constant mask
+ * or a multiplication by the reciprocal. Duplicate keys, or a displacement
+ * too large for map_t, make the constant evaluation fail by calling one of
+ * the non-constexpr functions below, whose name appears in the compiler
+ * diagnostic.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if PHF_HAVE_CONSTEXPR_TABLE
+namespace PHF {
+	namespace cx {
+		inline void duplicate_key() { abort(); }
+		inline void displacement_overflow() { abort(); }
+
+		template<bool nodiv>
+		constexpr size_t buckets(size_t n, size_t l) {
+			size_t n1 = PHF_MAX(n, 1), l1 = PHF_MAX(l, 1);
+
+			return (nodiv)? phf_powerup(n1 / PHF_MIN(l1, n1)) : phf_primeup(PHF_HOWMANY(n1, l1));
+		} /* buckets() */
+
+		template<bool nodiv>
+		constexpr size_t slots(size_t n, size_t a) {
+			size_t n1 = PHF_MAX(n, 1), a1 = PHF_MAX(PHF_MIN(a, 100), 1);
+
+			return (nodiv)? phf_powerup((n1 * 100) / a1) : phf_primeup((n1 * 100) / a1);
+		} /* slots() */
+
+		template<typename key_t, size_t R, size_t M, bool nodiv, typename map_t>
+		struct table {
+			static constexpr size_t r = R;
+			static constexpr size_t m = M;
+
+			phf_seed_t seed;
+			uint32_t d_max;
+			map_t g[R];
+
+			constexpr phf_hash_t operator()(key_t k) const {
+				uint32_t d = g[phf_g_mod_r<nodiv>(k, seed, R)];
+
+				return phf_f_mod_m<nodiv>(d, k, seed, M);
+			} /* operator()() */
+		}; /* struct table */
+
+		template<bool nodiv, size_t l = 4, size_t a = 80, typename map_t = uint8_t, typename key_t, size_t N>
+		constexpr table<key_t, buckets<nodiv>(N, l), slots<nodiv>(N, a), nodiv, map_t> make_table(const key_t (&k)[N], const phf_seed_t seed = 1792) {
+			constexpr size_t R = buckets<nodiv>(N, l);
+			constexpr size_t M = slots<nodiv>(N, a);
+			table<key_t, R, M, nodiv, map_t> t{};
+			phf_hash_t B_g[N] = {};   /* g(k) % r of each key */
+			size_t B_z[R] = {};       /* number of keys per bucket */
+			size_t B_o[R + 1] = {};   /* bucket offsets into B_k */
+			size_t B_n[R] = {};       /* keys placed per bucket so far */
+			size_t B_k[N] = {};       /* key indices grouped by bucket */
+			size_t order[R] = {};     /* non-empty buckets, largest first */
+			size_t z_n[N + 1] = {};   /* number of buckets per size */
+			phf_bits_t T[PHF_HOWMANY(M, PHF_BITS(phf_bits_t))] = {};
+			uint32_t f_b[N] = {};     /* working slots of current bucket */
+			size_t z_max = 0, nb = 0;
+
+			t.seed = seed;
+
+			for (size_t i = 0; i < N; i++) {
+				B_g[i] = phf_g_mod_r<nodiv>(k[i], seed, R);
+				B_z[B_g[i]]++;
+				z_max = PHF_MAX(z_max, B_z[B_g[i]]);
+			}
+
+			for (size_t b = 0; b < R; b++)
+				B_o[b + 1] = B_o[b] + B_z[b];
+			for (size_t i = 0; i < N; i++)
+				B_k[B_o[B_g[i]] + B_n[B_g[i]]++] = i;
+
+			/* counting sort by decreasing size, then decreasing g */
+			for (size_t b = 0; b < R; b++)
+				z_n[B_z[b]]++;
+			for (size_t z = z_max, o = 0; z > 0; z--) {
+				size_t c = z_n[z];
+				z_n[z] = o;
+				o += c;
+			}
+			for (size_t b = R; b-- > 0;) {
+				if (B_z[b] > 0) {
+					order[z_n[B_z[b]]++] = b;
+					nb++;
+				}
+			}
+
+			for (size_t o = 0; o < nb; o++) {
+				size_t b = order[o], z = B_z[b];
+				const size_t *Bi = &B_k[B_o[b]];
+				uint32_t d = 0;
+				bool collision = true;
+
+				for (size_t i = 0; i < z; i++) {
+					for (size_t j = i + 1; j < z; j++) {
+						if (k[Bi[i]] == k[Bi[j]])
+							duplicate_key();
+					}
+				}
+
+				while (collision) {
+					d++;
+					collision = false;
+
+					for (size_t i = 0; i < z && !collision; i++) {
+						f_b[i] = phf_f_mod_m<nodiv>(d, k[Bi[i]], seed, M);
+						collision = phf_isset(T, f_b[i]);
+
+						for (size_t j = 0; j < i && !collision; j++)
+							collision = (f_b[j] == f_b[i]);
+					}
+				}
+
+				for (size_t i = 0; i < z; i++)
+					phf_setbit(T, f_b[i]);
+
+				if (d > std::numeric_limits<map_t>::max())
+					displacement_overflow();
+
+				t.g[b] = static_cast<map_t>(d);
+				t.d_max = PHF_MAX(t.d_max, d);
+			}
+
+			return t;
+		} /* make_table() */
+	} /* cx:: */
+} /* PHF:: */
+#endif /* PHF_HAVE_CONSTEXPR_TABLE */
+
+
 #endif /* PHF_H */